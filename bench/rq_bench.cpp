@@ -0,0 +1,402 @@
+/*
+* rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Benchmark and PGO training driver.
+ *
+ * Replays a corpus of expressions and a history file through RofiQalc without rofi or X:
+ *  - every expression is "typed" one character at a time, like rofi calls preprocess_input,
+ *    and the time until the calculator thread reports back is the keystroke latency;
+ *  - the history file is loaded repeatedly through RofiQalc::load_history().
+ *
+ * Usage: rq-bench [--train] [--iterations N] <corpus dir> [mode options, e.g. -history-length 500]
+ * The corpus directory must contain expressions.txt and history.txt.
+ *
+ * rq-bench --differential N [--seed S] instead compares the native evaluator with libqalculate
+ * on N generated expressions, and fails if any of them print differently.
+ */
+#include "qalc.h"
+#include "native_eval.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <libqalculate/qalculate.h>
+#include <rofi/helper.h>
+
+using namespace rq;
+using Clock = std::chrono::steady_clock;
+
+static int bench_argc;
+static char ** bench_argv;
+
+/*
+ * RofiQalc reads its options through rofi's helpers, provide them here over our own argv so
+ * the mode options can be passed to the benchmark as-is.
+ */
+int find_arg(char const * const key)
+{
+    for (int i = 1; i < bench_argc; ++i) {
+        if (std::strcmp(bench_argv[i], key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int find_arg_uint(char const * const key, unsigned * val)
+{
+    int const index = find_arg(key);
+    if (index < 0 || index + 1 >= bench_argc) {
+        return FALSE;
+    }
+    *val = std::strtoul(bench_argv[index + 1], nullptr, 10);
+    return TRUE;
+}
+
+int find_arg_int(char const * const key, int * val)
+{
+    int const index = find_arg(key);
+    if (index < 0 || index + 1 >= bench_argc) {
+        return FALSE;
+    }
+    *val = static_cast<int>(std::strtol(bench_argv[index + 1], nullptr, 10));
+    return TRUE;
+}
+
+int find_arg_str(char const * const key, char ** val)
+{
+    int const index = find_arg(key);
+    if (index < 0 || index + 1 >= bench_argc) {
+        return FALSE;
+    }
+    *val = bench_argv[index + 1];
+    return TRUE;
+}
+
+struct EvalWaiter
+{
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+};
+
+static void eval_callback(void * userdata)
+{
+    auto * waiter = static_cast<EvalWaiter*>(userdata);
+    {
+        std::lock_guard lock(waiter->mtx);
+        waiter->done = true;
+    }
+    waiter->cv.notify_one();
+}
+
+static std::vector<std::string> read_lines(std::filesystem::path const & path)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line)) {
+        if (!line.empty() && !line.starts_with('#')) {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+
+/** Evaluates every prefix of every expression, returns the latency of each keystroke */
+static std::vector<double> replay_expressions(RofiQalc & state, std::vector<std::string> const & expressions)
+{
+    std::vector<double> latencies_us;
+    EvalWaiter waiter;
+    std::string typed;
+
+    for (auto const & expression : expressions) {
+        for (size_t length = 1; length <= expression.length(); ++length) {
+            std::string_view const prefix{expression.data(), length};
+            // RofiQalc skips evaluating the same expression twice in a row
+            if (prefix == typed) {
+                continue;
+            }
+            typed = prefix;
+
+            waiter.done = false;
+            auto const start = Clock::now();
+            state.evaluate(prefix, eval_callback, &waiter);
+            {
+                std::unique_lock lock(waiter.mtx);
+                waiter.cv.wait(lock, [&waiter] { return waiter.done; });
+            }
+            auto const elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start);
+            latencies_us.push_back(elapsed.count());
+        }
+    }
+
+    return latencies_us;
+}
+
+static std::vector<double> replay_history_loads(RofiQalc & state, unsigned iterations)
+{
+    std::vector<double> load_times_us;
+
+    for (unsigned i = 0; i < iterations; ++i) {
+        auto const start = Clock::now();
+        state.load_history();
+        auto const elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start);
+        load_times_us.push_back(elapsed.count());
+    }
+
+    return load_times_us;
+}
+
+static void print_stats(char const * name, std::vector<double> samples)
+{
+    if (samples.empty()) {
+        std::printf("%-18s no samples\n", name);
+        return;
+    }
+    std::ranges::sort(samples);
+
+    double sum = 0;
+    for (double const sample : samples) {
+        sum += sample;
+    }
+    auto const percentile = [&samples](double p) {
+        return samples[static_cast<size_t>(p * static_cast<double>(samples.size() - 1))];
+    };
+
+    std::printf("%-18s n=%-6zu mean=%10.1f us  p50=%10.1f us  p95=%10.1f us  max=%10.1f us\n",
+        name, samples.size(), sum / static_cast<double>(samples.size()),
+        percentile(0.5), percentile(0.95), samples.back());
+}
+
+/** Generates random plain arithmetic, mostly within what native_eval handles */
+class ExpressionGenerator
+{
+public:
+    explicit ExpressionGenerator(unsigned seed)
+        : _rng(seed)
+    {
+    }
+
+    std::string next()
+    {
+        std::string expression;
+        _append_expression(expression, 0);
+        return expression;
+    }
+
+private:
+    int _pick(int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(_rng);
+    }
+
+    void _append_number(std::string & out)
+    {
+        switch (_pick(0, 3)) {
+            case 0:
+                out += std::to_string(_pick(0, 9));
+                break;
+            case 1:
+                out += std::to_string(_pick(0, 100000));
+                break;
+            case 2:
+                out += std::to_string(_pick(0, 999)) + "." + std::to_string(_pick(0, 999));
+                break;
+            default:
+                out += "0." + std::to_string(_pick(1, 99));
+                break;
+        }
+    }
+
+    void _append_expression(std::string & out, int depth)
+    {
+        static constexpr char const * operators[] = { "+", "-", "*", "/", " + ", " - ", " * ", " / ", "−", "×", "÷" };
+
+        if (depth > 3 || _pick(0, 2) == 0) {
+            if (_pick(0, 5) == 0) {
+                out += '-';
+            }
+            _append_number(out);
+            return;
+        }
+
+        switch (_pick(0, 5)) {
+            case 0:
+                out += '(';
+                _append_expression(out, depth + 1);
+                out += ')';
+                break;
+            case 1:
+                _append_expression(out, depth + 1);
+                out += '^';
+                out += std::to_string(_pick(-3, 6));
+                break;
+            default:
+                _append_expression(out, depth + 1);
+                out += operators[_pick(0, static_cast<int>(std::size(operators)) - 1)];
+                _append_expression(out, depth + 1);
+                break;
+        }
+    }
+
+    std::mt19937 _rng;
+};
+
+/**
+ * Evaluates generated expressions with native_eval and with libqalculate, printing both results
+ * with the mode's print options.
+ * @return Number of expressions the two printed differently
+ */
+static unsigned run_differential(unsigned count, unsigned seed)
+{
+    Calculator calc;
+    PrintOptions po = default_print_options;
+    // Same as RofiQalc prints results with
+    po.use_unicode_signs = true;
+    po.interval_display = INTERVAL_DISPLAY_SIGNIFICANT_DIGITS;
+
+    ExpressionGenerator generator{seed};
+    unsigned native = 0;
+    unsigned mismatches = 0;
+
+    for (unsigned i = 0; i < count; ++i) {
+        std::string const expression = generator.next();
+
+        Number value;
+        if (!native_eval::evaluate(expression, value)) {
+            continue;
+        }
+        native += 1;
+        std::string const native_result = calc.print(MathStructure(value), 2000, po);
+
+        MathStructure mstruct;
+        calc.calculate(&mstruct, calc.unlocalizeExpression(expression), 2000, default_evaluation_options);
+        std::string const qalc_result = calc.print(mstruct, 2000, po);
+        calc.clearMessages();
+
+        if (native_result != qalc_result) {
+            mismatches += 1;
+            std::printf("MISMATCH %s\n  native:       %s\n  libqalculate: %s\n",
+                expression.c_str(), native_result.c_str(), qalc_result.c_str());
+        }
+    }
+
+    std::printf("%u expressions, %u evaluated natively, %u mismatches\n", count, native, mismatches);
+    return mismatches;
+}
+
+/**
+ * Points libqalculate's and our data directories to a scratch directory, so the benchmark
+ * never touches the user's history file or caches.
+ */
+static std::filesystem::path setup_scratch_dir(std::filesystem::path const & corpus_dir)
+{
+    gchar * tmp = g_dir_make_tmp("rq-bench-XXXXXX", nullptr);
+    if (tmp == nullptr) {
+        std::fprintf(stderr, "Failed to create scratch directory\n");
+        std::exit(EXIT_FAILURE);
+    }
+    std::filesystem::path const scratch_dir{tmp};
+    g_free(tmp);
+
+    g_setenv("XDG_DATA_HOME", (scratch_dir / "data").c_str(), TRUE);
+    g_setenv("XDG_CACHE_HOME", (scratch_dir / "cache").c_str(), TRUE);
+
+    std::filesystem::create_directories(scratch_dir / "data" / "rofi");
+    std::filesystem::copy_file(corpus_dir / "history.txt",
+        scratch_dir / "data" / "rofi" / "rofi_calc_history");
+
+    return scratch_dir;
+}
+
+int main(int argc, char ** argv)
+{
+    bench_argc = argc;
+    bench_argv = argv;
+
+    bool train = false;
+    unsigned iterations = 5;
+    unsigned differential = 0;
+    unsigned seed = 1;
+    std::filesystem::path corpus_dir;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--train") == 0) {
+            train = true;
+        } else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--differential") == 0 && i + 1 < argc) {
+            differential = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        } else if (corpus_dir.empty() && std::filesystem::is_directory(argv[i])) {
+            // Anything else is a mode option, picked up through find_arg()
+            corpus_dir = argv[i];
+        }
+    }
+    if (differential > 0) {
+        return run_differential(differential, seed) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (corpus_dir.empty()) {
+        std::fprintf(stderr,
+            "Usage: %s [--train] [--iterations N] <corpus dir> [mode options]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto const expressions = read_lines(corpus_dir / "expressions.txt");
+    auto const scratch_dir = setup_scratch_dir(corpus_dir);
+
+    {
+        auto const start = Clock::now();
+        RofiQalc state;
+        auto const elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start);
+
+        auto const history_load_us = replay_history_loads(state, iterations);
+        // History is loaded through libqalculate, which the calculator thread owns once started
+        state.start();
+        std::vector<double> keystroke_us;
+        for (unsigned i = 0; i < iterations; ++i) {
+            auto const latencies = replay_expressions(state, expressions);
+            keystroke_us.insert(keystroke_us.end(), latencies.begin(), latencies.end());
+        }
+        state.save_history();
+
+        if (!train) {
+            std::printf("%-18s %.1f ms\n", "startup", elapsed.count());
+            print_stats("history load", history_load_us);
+            print_stats("keystroke latency", keystroke_us);
+        }
+    }
+
+    std::filesystem::remove_all(scratch_dir);
+    return EXIT_SUCCESS;
+}
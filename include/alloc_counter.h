@@ -0,0 +1,79 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Allocation counting for auditing the keystroke path, enabled with the alloc_counting build
+ * option. Counts every operator new call, per thread. Without the option everything here
+ * compiles to nothing.
+ */
+
+namespace rq::alloc_counter
+{
+
+struct Counts
+{
+    /** Allocations made by rofi-qalc itself */
+    uint64_t own = 0;
+    /** Allocations made inside an ExternalScope, i.e. by libqalculate */
+    uint64_t external = 0;
+};
+
+#ifdef RQ_ALLOC_COUNTING
+
+/** Allocations made by the calling thread so far */
+Counts thread_counts();
+
+/** Logs the allocations the calling thread made since start */
+void log_since(char const * what, Counts const & start);
+
+/** Counts the calling thread's allocations as external while it exists */
+class ExternalScope
+{
+public:
+    ExternalScope();
+    ~ExternalScope();
+
+    ExternalScope(ExternalScope const &) = delete;
+    ExternalScope & operator=(ExternalScope const &) = delete;
+};
+
+#else
+
+constexpr Counts thread_counts()
+{
+    return {};
+}
+
+constexpr void log_since(char const *, Counts const &)
+{
+}
+
+class ExternalScope
+{
+public:
+    // User-provided so the scopes don't trigger unused variable warnings
+    ExternalScope() {}
+};
+
+#endif
+
+} /* namespace rq::alloc_counter */
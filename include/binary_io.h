@@ -0,0 +1,70 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * Helpers for the binary cache files, all integers in host byte order (the caches never leave
+ * the machine). Strings are stored as u16 length and bytes.
+ */
+namespace rq::binary_io
+{
+
+template <typename T>
+inline void put(std::string & out, T const value)
+{
+    out.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+/** Strings longer than UINT16_MAX are truncated */
+inline void put_string(std::string & out, std::string const & value)
+{
+    put(out, static_cast<uint16_t>(value.length() < UINT16_MAX ? value.length() : UINT16_MAX));
+    out.append(value, 0, UINT16_MAX);
+}
+
+/** @return Whether in was long enough, in is advanced past the value */
+template <typename T>
+inline bool get(std::string_view & in, T & value)
+{
+    if (in.length() < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+/** @return Whether in was long enough, value points into in's data */
+inline bool get_string(std::string_view & in, std::string_view & value)
+{
+    uint16_t length;
+    if (!get(in, length) || in.length() < length) {
+        return false;
+    }
+    value = in.substr(0, length);
+    in.remove_prefix(length);
+    return true;
+}
+
+} /* namespace rq::binary_io */
@@ -0,0 +1,94 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rq
+{
+
+/**
+ * Names of units, functions and variables, aliases included, for completing the name being
+ * typed. Sorted and deduplicated, with the text of all names in a single buffer.
+ *
+ * Built by the calculator thread and handed to the main thread, see ThreadData::completion_index.
+ */
+class CompletionIndex
+{
+public:
+    /** Removes all names, keeping the buffers for the next build */
+    void clear();
+    /** Adds a name, sort() has to be called before lookups */
+    void add(std::string_view name);
+    /** Sorts the names and drops duplicates */
+    void sort();
+
+    [[nodiscard]]
+    size_t size() const
+    {
+        return this->_names.size();
+    }
+
+    /** Heap bytes held by the index */
+    [[nodiscard]]
+    size_t memory_usage() const
+    {
+        return this->_text.capacity() + this->_names.capacity() * sizeof(Name);
+    }
+
+    /** Calls visitor with every name starting with prefix, in sorted order */
+    template <typename Visitor>
+    void for_each_with_prefix(std::string_view prefix, Visitor && visitor) const
+    {
+        for (size_t i = _lower_bound(prefix); i < this->_names.size(); ++i) {
+            auto const name = _name(i);
+            if (!name.starts_with(prefix)) {
+                break;
+            }
+            visitor(name);
+        }
+    }
+
+private:
+    struct Name
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    [[nodiscard]]
+    std::string_view _name(size_t index) const
+    {
+        return std::string_view{this->_text}.substr(this->_names[index].offset, this->_names[index].length);
+    }
+
+    /** Index of the first name not less than prefix */
+    [[nodiscard]]
+    size_t _lower_bound(std::string_view prefix) const;
+
+    /** Text of all names, back to back */
+    std::string _text;
+    /** Names in _text, in sorted order after sort() */
+    std::vector<Name> _names;
+};
+
+} /* namespace rq */
@@ -0,0 +1,103 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class Calculator;
+
+namespace rq
+{
+class DefinitionsIndex;
+}
+
+namespace rq::definitions
+{
+
+/** Categories of libqalculate's global definitions, each is a separate definitions file */
+enum Category : unsigned
+{
+    PREFIXES    = 1 << 0,
+    CURRENCIES  = 1 << 1,
+    UNITS       = 1 << 2,
+    FUNCTIONS   = 1 << 3,
+    DATASETS    = 1 << 4,
+    VARIABLES   = 1 << 5,
+
+    ALL         = PREFIXES | CURRENCIES | UNITS | FUNCTIONS | DATASETS | VARIABLES,
+};
+
+/** Modification time and size of a definitions file, -1 if there's no such file */
+struct FileStamp
+{
+    int64_t mtime = -1;
+    int64_t size = -1;
+
+    bool operator==(FileStamp const &) const = default;
+};
+
+/**
+ * Looks up a category by name, e.g. "units".
+ * @return The category, 0 if there is no such category
+ */
+unsigned find_category(std::string_view const & name);
+
+/**
+ * Stamp of the global definitions file of a category, e.g. units.xml.
+ * There are no files when libqalculate has its definitions compiled in.
+ */
+FileStamp file_stamp(unsigned category);
+
+/**
+ * Stamp of the local definitions, the files in ~/.local/share/qalculate/definitions: the newest
+ * modification time of them and the directory, and their total size. -1 if there's no such directory.
+ */
+FileStamp local_stamp();
+
+/**
+ * Language libqalculate translates the names and titles of global definitions into, the message
+ * locale and LANGUAGE, which gettext prefers over it. What's cached of them only holds for the same one.
+ */
+std::string message_locale();
+
+/**
+ * Loads global definition categories, along with the categories they depend on.
+ * @param categories Categories to load
+ * @param loaded Categories loaded before, those are skipped
+ * @param index Gets the names of categories it hasn't indexed yet, may be nullptr
+ * @return All loaded categories
+ */
+unsigned load(Calculator & calc, unsigned categories, unsigned loaded, DefinitionsIndex * index);
+
+/**
+ * Loads the categories not loaded yet that may define the names in the expression libqalculate
+ * doesn't know, one at a time, until every name is known or no category is left that defines it.
+ * @param loaded Categories loaded before, those are skipped
+ * @param index Names of the categories, without one every category is loaded until the names are known
+ * @return All loaded categories
+ */
+unsigned load_for_expression(Calculator & calc, std::string_view const & expression, unsigned loaded,
+                             DefinitionsIndex * index);
+
+/** Checks whether libqalculate knows about the name, either as is or as a prefixed unit */
+bool is_known_name(Calculator & calc, std::string const & name);
+
+} /* namespace rq::definitions */
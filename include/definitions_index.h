@@ -0,0 +1,89 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "definitions.h"
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Calculator;
+
+namespace rq
+{
+
+/**
+ * Names each category of global definitions adds to the calculator, so a name libqalculate doesn't
+ * know only loads the categories defining it. Half-typed names and variables that aren't assigned
+ * yet don't load anything then.
+ *
+ * A category's names are recorded when it's loaded and kept in a cache file, for as long as its
+ * definitions file, libqalculate and the language stay the same. Categories without recorded names
+ * may define any name.
+ */
+class DefinitionsIndex
+{
+public:
+    /** Reads the cache file, categories whose definitions file has changed since aren't indexed */
+    void read();
+
+    /** Whether the names of the category are known */
+    [[nodiscard]]
+    bool is_indexed(unsigned category) const;
+
+    /**
+     * Finds the categories that may define the name, either as is or as a prefixed unit.
+     * @param categories Categories to look in
+     * @return The indexed categories defining the name and the categories that aren't indexed
+     */
+    [[nodiscard]]
+    unsigned find(Calculator & calc, std::string_view name, unsigned categories) const;
+
+    /** Every name the calculator knows, sorted, see record() */
+    [[nodiscard]]
+    static std::vector<std::string> collect_names(Calculator & calc);
+
+    /**
+     * Indexes the names loading a category has added and writes the cache file.
+     * @param before collect_names() from before loading the category
+     */
+    void record(Calculator & calc, unsigned category, std::vector<std::string> const & before);
+
+private:
+    static constexpr size_t CATEGORY_COUNT = std::bit_width<unsigned>(definitions::ALL);
+
+    struct Entry
+    {
+        bool is_indexed = false;
+        /** Modification time and size of the definitions file, -1 if there's none */
+        int64_t mtime = -1;
+        int64_t size = -1;
+        /** Sorted names */
+        std::vector<std::string> names;
+    };
+
+    void _write() const;
+
+    Entry _entries[CATEGORY_COUNT];
+};
+
+} /* namespace rq */
@@ -0,0 +1,59 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Calculator;
+
+namespace rq::definitions_snapshot
+{
+
+/** What calc held before a category was loaded, so write() can tell what loading it changed */
+struct Baseline
+{
+    size_t prefix_count = 0;
+    /** Names of the units and variables, built-in ones are renamed by loading */
+    std::vector<std::string> unit_names;
+    std::vector<std::string> variable_names;
+};
+
+/** Whether a definition category has a snapshot, prefixes, units and variables do. See definitions.h */
+bool is_supported(unsigned category);
+
+Baseline take_baseline(Calculator const & calc);
+
+/**
+ * Restores the definitions of a category from the snapshot written by write(), instead of parsing
+ * its XML file. Only done if the snapshot was written for the same file, libqalculate version and
+ * message locale.
+ * @return Whether the definitions were restored, calc is left untouched otherwise
+ */
+bool restore(Calculator & calc, unsigned category);
+
+/**
+ * Writes a snapshot of the definitions loading a category has added or changed.
+ * Nothing is written if any of them can't be recreated from a snapshot.
+ * @param baseline take_baseline() from right before loading the category
+ */
+void write(Calculator & calc, unsigned category, Baseline const & baseline);
+
+} /* namespace rq::definitions_snapshot */
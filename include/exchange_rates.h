@@ -0,0 +1,50 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+class Calculator;
+
+namespace rq::exchange_rates
+{
+
+/**
+ * Checks whether evaluating the expression may need exchange rates.
+ * True if any name in it is a currency unit, or a currency code libqalculate doesn't know about
+ * yet (currencies only present in the downloaded rate files are created by loading them).
+ */
+bool expression_needs_rates(Calculator & calc, std::string_view const & expression);
+
+/**
+ * Loads exchange rates into the calculator.
+ * Uses the rate cache when it is newer than libqalculate's rate files, otherwise parses the
+ * rate files and refreshes the cache.
+ * @return Whether the rates were loaded
+ */
+bool load(Calculator & calc);
+
+/**
+ * Combines the modification times of libqalculate's rate files into a single value,
+ * the rate cache is only valid for the exact set of rate files it was created from.
+ */
+int64_t source_stamp(Calculator & calc);
+
+} /* namespace rq::exchange_rates */
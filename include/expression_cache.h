@@ -0,0 +1,94 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class Calculator;
+class MathStructure;
+struct EvaluationOptions;
+
+namespace rq
+{
+
+enum class QueryKind
+{
+    /** Plain expression */
+    PLAIN,
+    /** Call to plot() */
+    PLOT,
+    /** Variable or function assignment, e.g. "a = 20" */
+    ASSIGNMENT,
+    /** Expression with a conversion, e.g. "3 km to mi" or "255 to hex" */
+    CONVERSION,
+};
+
+struct ParsedExpression
+{
+    /** Unlocalized expression, including the conversion */
+    std::string unlocalized;
+    /** Unlocalized conversion target, the part after "to", empty if there is none */
+    std::string conversion;
+    /** Unlocalized expression without the conversion, empty for assignments */
+    std::string base;
+    /** Parsed but not evaluated expression without the conversion, nullptr if it has to be evaluated from text */
+    std::unique_ptr<MathStructure> parsed;
+    QueryKind kind = QueryKind::PLAIN;
+    /** Whether the conversion target consists of units only, so calculate() can convert it */
+    bool is_unit_conversion = false;
+};
+
+/**
+ * Cache of unlocalized and parsed expressions, keyed by the raw input.
+ * Only used from the calculator thread.
+ */
+class ExpressionCache
+{
+public:
+    explicit ExpressionCache(size_t capacity);
+    ~ExpressionCache();
+
+    /**
+     * Looks up an expression, parsing it on a miss.
+     * @param generation Definitions generation, the cache is emptied when it changes
+     * @note The returned reference is valid until the next get() or clear() call
+     */
+    ParsedExpression const & get(Calculator & calc, std::string const & expression,
+                                 EvaluationOptions const & eo, unsigned generation);
+
+    void clear();
+
+private:
+    using Entry = std::pair<std::string, ParsedExpression>;
+
+    size_t _capacity;
+    unsigned _generation = 0;
+    /** Entries in most recently used first order */
+    std::list<Entry> _entries;
+    /** Index into _entries, keys point to the strings in _entries */
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> _index;
+    /** Structure taken from a recycled entry, reused by the next parse */
+    std::unique_ptr<MathStructure> _spare_structure;
+};
+
+} /* namespace rq */
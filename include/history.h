@@ -0,0 +1,147 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <list>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rq
+{
+
+struct HistoryEntry
+{
+    std::string expression;
+    std::string result;
+    /** Indicates whether the history entry should be persistent (stored in the history file) */
+    bool persistent;
+    /** Indicates whether the history entry is an assignment (lacking a result) */
+    bool is_assignment;
+    /** Assigned by History::append(), stays the same when the entry moves or its result changes */
+    unsigned id = 0;
+
+    [[nodiscard]]
+    std::string print() const
+    {
+        std::stringstream ss;
+        ss << expression;
+        if (!is_assignment) {
+            ss << separator << result;
+        }
+        return ss.str();
+    }
+
+    static constexpr std::string_view separator = " = ";
+};
+
+/**
+ * History entries, oldest first.
+ * With deduplication enabled an entry with the same expression and result as an existing one
+ * isn't added again, the existing one is moved to the end instead. Duplicates are found through
+ * a hash index, so that takes constant time.
+ */
+class History
+{
+public:
+    explicit History(bool deduplicate);
+
+    [[nodiscard]]
+    size_t size() const
+    {
+        return this->_entries.size();
+    }
+
+    /**
+     * Entry by position, 0 being the oldest.
+     * Positions are looked up in constant time, except for the first lookup after a change.
+     */
+    [[nodiscard]]
+    HistoryEntry const & operator[](size_t index) const;
+
+    [[nodiscard]]
+    auto begin() const
+    {
+        return this->_entries.cbegin();
+    }
+
+    [[nodiscard]]
+    auto end() const
+    {
+        return this->_entries.cend();
+    }
+
+    /** Entry by HistoryEntry::id, nullptr if it has been removed */
+    [[nodiscard]]
+    HistoryEntry const * find(unsigned id) const;
+
+    /** Estimated heap bytes held by the entries and the indexes */
+    [[nodiscard]]
+    size_t memory_usage() const;
+
+    /**
+     * Adds an entry as the newest one, or moves its duplicate there.
+     * @return The added entry, or the duplicate that was moved
+     */
+    HistoryEntry const & append(HistoryEntry entry);
+    /** Replaces the result of an entry, returns whether there was one with the id */
+    bool set_result(unsigned id, std::string result);
+    void erase(size_t index);
+    /** Removes the oldest entry */
+    void pop_front();
+    void clear();
+
+private:
+    using Entries = std::list<HistoryEntry>;
+
+    /** Index key, points to the strings of the entry */
+    struct Key
+    {
+        std::string_view expression;
+        std::string_view result;
+
+        bool operator==(Key const &) const = default;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(Key const & key) const;
+    };
+
+    /** Removes the entry from the duplicate lookup */
+    void _unindex(Entries::const_iterator it);
+    void _erase(Entries::const_iterator it);
+    void _update_positions() const;
+
+    bool _deduplicate;
+    Entries _entries;
+    /** Last HistoryEntry::id handed out */
+    unsigned _last_id = 0;
+    /** Entries by HistoryEntry::id */
+    std::unordered_map<unsigned, Entries::iterator> _ids;
+    /** Duplicate lookup, only filled in with deduplication enabled */
+    std::unordered_map<Key, Entries::iterator, KeyHash> _index;
+    /** Entries by position, rebuilt by the first operator[] call after a change */
+    mutable std::vector<Entries::const_iterator> _positions;
+    mutable bool _positions_valid = false;
+};
+
+} /* namespace rq */
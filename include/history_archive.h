@@ -0,0 +1,101 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "history.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rq
+{
+
+/**
+ * Append-only store for history entries that dropped out of the history file.
+ *
+ * Entries are kept in segment files, each a series of zlib-compressed blocks. Every append()
+ * adds one block, a new segment is started once the last one is over SEGMENT_SIZE. Each segment
+ * has an index with a record per block: where the block is, how many entries it holds and which
+ * trigrams occur in it, so a search only decompresses the blocks that may have a match.
+ *
+ * Nothing is read before the first append() or search().
+ */
+class HistoryArchive
+{
+public:
+    /** Compressed size after which a segment is closed */
+    static constexpr uint64_t SEGMENT_SIZE = 1024 * 1024;
+
+    explicit HistoryArchive(std::string directory);
+
+    /**
+     * Adds entries, oldest first, as a new block.
+     * @return Whether they were written
+     */
+    bool append(std::vector<HistoryEntry> const & entries);
+
+    /**
+     * Looks for entries with needle in their expression or result, newest first.
+     * @param limit Maximum size of matches, the search stops once it's reached
+     * @param matches Matches are appended to it
+     */
+    void search(std::string_view needle, size_t limit, std::vector<HistoryEntry> & matches);
+
+private:
+    /** Index record of a block */
+    struct Block
+    {
+        /** Position of the block in the segment */
+        uint64_t offset;
+        uint32_t compressed_size;
+        uint32_t raw_size;
+        uint32_t entry_count;
+        uint32_t reserved;
+        /** Bitmap of the hashed trigrams in the block, see trigram_bit() */
+        uint8_t trigrams[32];
+    };
+
+    struct Segment
+    {
+        unsigned number;
+        /** End of the last indexed block, the segment file may have a torn write after it */
+        uint64_t size;
+        std::vector<Block> blocks;
+    };
+
+    /** Reads the indexes of all segments */
+    void _load();
+    /** Reads and decompresses a block into _raw */
+    bool _read_block(std::FILE * segment_file, Block const & block);
+    [[nodiscard]]
+    std::string _path(unsigned segment, char const * extension) const;
+
+    std::string _directory;
+    bool _loaded = false;
+    /** Segments, oldest first */
+    std::vector<Segment> _segments;
+    /** Scratch buffers for blocks */
+    std::string _compressed;
+    std::string _raw;
+};
+
+} /* namespace rq */
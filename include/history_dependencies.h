@@ -0,0 +1,73 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "history.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rq
+{
+
+/**
+ * Which history entries use which names, so the results of the entries using a variable can be
+ * evaluated again once it changes.
+ *
+ * Names are the identifiers in the expression as parsing::for_each_identifier() finds them, so
+ * units and functions end up in here as well. Those are never assigned through the mode, so
+ * they only cost their place in the map. Entries are kept by HistoryEntry::id, ids of removed
+ * entries are dropped once the name is looked up.
+ */
+class HistoryDependencies
+{
+public:
+    /** Records the names the entry uses, assignments have no result to update and are skipped */
+    void add(HistoryEntry const & entry);
+    void clear();
+
+    /**
+     * Appends the entries of history that use the name, in the order they were added.
+     * @return Whether any were found
+     */
+    bool collect(std::string_view name, History const & history, std::vector<HistoryEntry> & entries);
+
+    /** Estimated heap bytes held by the graph */
+    [[nodiscard]]
+    size_t memory_usage() const;
+
+private:
+    struct NameHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view name) const
+        {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+    /** Ids of the entries using each name, in the order they were added */
+    std::unordered_map<std::string, std::vector<unsigned>, NameHash, std::equal_to<>> _dependents;
+};
+
+} /* namespace rq */
@@ -0,0 +1,70 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace rq
+{
+
+struct HistoryLine
+{
+    /** Line contents, without the newline */
+    std::string_view text;
+    /** Position of the last " = " separator in text, npos if there is none */
+    size_t separator;
+    /**
+     * Whether the line may be an assignment.
+     * False means it certainly isn't one, so only candidates need libqalculate's check.
+     */
+    bool maybe_assignment;
+};
+
+/**
+ * Splits a history file into lines.
+ * Newlines and '=' signs are found in the same pass over the data, vectorized with SSE2 when
+ * available. Whether a line can be an assignment is decided from those positions, the text
+ * before the first '=' is the only part inspected further.
+ */
+class HistoryScanner
+{
+public:
+    /**
+     * @param data History file contents, must outlive the scanner
+     * @param save_keywords Names of libqalculate's save function
+     */
+    HistoryScanner(std::string_view data, std::span<std::string const> save_keywords);
+
+    /**
+     * Reads the next line.
+     * @return False once all of the data has been read
+     */
+    bool next(HistoryLine & line);
+
+private:
+    bool _may_be_assignment(std::string_view const & line, size_t first_equals) const;
+
+    std::string_view _data;
+    std::span<std::string const> _save_keywords;
+    size_t _pos = 0;
+};
+
+} /* namespace rq */
@@ -19,8 +19,10 @@
 #pragma once
 
 #include <format>
+#include <iterator>
 #include <string>
 #include <utility>
+#include <vector>
 
 class CalculatorMessage;
 
@@ -36,19 +38,79 @@ enum MessageType
 
 struct LogMessage
 {
-    MessageType type;
+    MessageType type = INFORMATION;
     std::string message;
 
-    explicit LogMessage(CalculatorMessage const & message);
+    constexpr LogMessage() = default;
 
     constexpr LogMessage(MessageType type, std::string message)
         : type(type), message(std::move(message))
     {}
+};
+
+/**
+ * List of messages which keeps the strings of cleared messages around, so refilling it
+ * only allocates when a message is longer than the one it replaces.
+ */
+class LogMessages
+{
+public:
+    using const_iterator = std::vector<LogMessage>::const_iterator;
+
+    void clear()
+    {
+        this->_count = 0;
+    }
+
+    void add(CalculatorMessage const & message);
 
     template <typename... Args>
-    constexpr LogMessage(MessageType type, std::string const & format, Args&&... args)
-        : type(type), message(std::vformat(format, std::make_format_args(args...)))
-    {}
+    void add(MessageType type, std::format_string<Args...> format, Args&&... args)
+    {
+        auto & text = _next(type);
+        std::format_to(std::back_inserter(text), format, std::forward<Args>(args)...);
+    }
+
+    [[nodiscard]]
+    bool empty() const
+    {
+        return this->_count == 0;
+    }
+
+    [[nodiscard]]
+    size_t size() const
+    {
+        return this->_count;
+    }
+
+    [[nodiscard]]
+    const_iterator begin() const
+    {
+        return this->_messages.begin();
+    }
+
+    [[nodiscard]]
+    const_iterator end() const
+    {
+        return this->_messages.begin() + this->_count;
+    }
+
+private:
+    /** Sets up the next message, returns its emptied text */
+    std::string & _next(MessageType type)
+    {
+        if (this->_count == this->_messages.size()) {
+            this->_messages.emplace_back();
+        }
+        auto & message = this->_messages[this->_count++];
+        message.type = type;
+        message.message.clear();
+        return message.message;
+    }
+
+    std::vector<LogMessage> _messages;
+    /** Number of messages in use, the rest of _messages are spares */
+    size_t _count = 0;
 };
 
 }
@@ -0,0 +1,104 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace rq
+{
+
+/**
+ * Resident memory and heap changes per startup phase, plus estimates of the bytes the mode's own
+ * containers hold, logged on request. Enabled with Options::memory_report, otherwise recording
+ * does nothing.
+ *
+ * Heap usage is glibc's mallinfo2() count of allocated bytes, so it covers every thread.
+ */
+class MemoryReport
+{
+public:
+    struct Usage
+    {
+        long rss_kib = 0;
+        long heap_kib = 0;
+    };
+
+    struct Estimate
+    {
+        char const * what;
+        size_t bytes;
+    };
+
+    explicit MemoryReport(bool enabled);
+
+    /** Current usage of the process, 0 for what's unknown */
+    [[nodiscard]]
+    static Usage usage();
+
+    /** Resident set size of the process in KiB, 0 if unknown */
+    [[nodiscard]]
+    static long rss_kib();
+
+    /** Heap bytes a string holds, 0 if it fits in the string object itself */
+    [[nodiscard]]
+    static size_t string_bytes(std::string const & string)
+    {
+        auto const * object = reinterpret_cast<char const *>(&string);
+        bool const is_inline = string.data() >= object && string.data() < object + sizeof(string);
+        return is_inline ? 0 : string.capacity() + 1;
+    }
+
+    [[nodiscard]]
+    bool enabled() const
+    {
+        return this->_enabled;
+    }
+
+    /** Starts the next phase of mark() from here, without recording anything */
+    void restart();
+
+    /** Records the change since the previous mark() or restart() as a phase, main thread only */
+    void mark(char const * phase);
+
+    /** Records the change since before as a phase, from any thread */
+    void add(char const * phase, Usage const & before);
+
+    /** Logs the phases recorded so far, followed by the estimates */
+    void log(std::span<Estimate const> estimates) const;
+
+private:
+    struct Phase
+    {
+        char const * name;
+        Usage delta;
+    };
+
+    bool _enabled;
+    /** Usage at the previous mark() or restart() */
+    Usage _previous;
+    /** Guards _phases, add() is called from the calculator thread as well */
+    mutable std::mutex _mtx;
+    std::vector<Phase> _phases;
+};
+
+} /* namespace rq */
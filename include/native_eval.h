@@ -0,0 +1,40 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <string_view>
+
+class Number;
+
+namespace rq::native_eval
+{
+
+/**
+ * Evaluates plain arithmetic without going through libqalculate's parser and evaluator.
+ *
+ * Understands decimal numbers, + - * / ^ (also ** and the unicode − × ÷), unary signs and
+ * parentheses, with the same precedence as libqalculate. The arithmetic is done on exact
+ * rationals. Anything else -- names, units, functions, implicit multiplication, results that
+ * wouldn't be exact -- is left to libqalculate.
+ * @param result Receives the exact result
+ * @return Whether the expression was evaluated, result is unspecified if not
+ */
+bool evaluate(std::string_view expression, Number & result);
+
+} /* namespace rq::native_eval */
@@ -20,6 +20,9 @@
 
 #include "log_message.h"
 
+#include <string>
+#include <vector>
+
 namespace rq
 {
 
@@ -37,6 +40,10 @@ struct Options
     bool auto_save_last_to_history;
     /** Maximum number of history entries cached */
     unsigned history_length = 100;
+    /** Keep a single history entry per expression and result, see History */
+    bool deduplicate_history;
+    /** Move entries beyond history_length to a compressed archive instead of dropping them, see HistoryArchive */
+    bool history_archive;
     /** Whether to automatically clear the filter text after adding to history  */
     bool no_auto_clear_filter;
     /** Whether to not load variables into qalculate from history */
@@ -51,6 +58,44 @@ struct Options
      * See ::MessageType for values.
      */
     unsigned message_severity = ERROR;
+    /**
+     * Load exchange rates in the background after this many milliseconds without input.
+     * 0 loads them only once an expression references a currency.
+     */
+    unsigned exchange_rates_idle_ms = 0;
+    /** Names of additional formats to show the result in, see result_formats.h */
+    std::vector<std::string> result_formats;
+    /**
+     * Time budget of the first, approximate evaluation phase in milliseconds.
+     * Its result is shown while the exact result is computed, 0 disables the approximate phase.
+     */
+    unsigned progressive_eval_ms = 0;
+    /**
+     * Global definition categories to load at startup, see definitions.h. Empty loads all of them.
+     * The rest are loaded once an expression uses a name libqalculate doesn't know.
+     */
+    std::vector<std::string> definitions;
+    /** Evaluate in a subprocess which is killed when it overruns eval_timeout_ms, see sandbox.h */
+    bool sandbox_eval;
+    /** Address space limit of the evaluation subprocess in MiB, 0 for no limit */
+    unsigned sandbox_memory_mb = 1024;
+    /**
+     * Results longer than this many digits, or characters if they're not integers, are shown
+     * abbreviated. 0 shows them in full.
+     */
+    unsigned max_result_digits = 200;
+    /** Results kept in the result cache file, 0 disables it, see ResultCache */
+    unsigned result_cache = 0;
+    /** Always evaluate with libqalculate, also plain arithmetic, see native_eval.h */
+    bool no_native_eval;
+    /** Run background work like loading exchange rates with the SCHED_IDLE policy, see task_scheduler.h */
+    bool background_sched_idle;
+    /** Log memory used per startup phase and held by the mode's containers on exit, see MemoryReport */
+    bool memory_report;
+    /** Evaluate the history entries using a variable again when it's assigned or removed */
+    bool recompute_history;
+    /** Draw plot(FUNCTION) and plot(FUNCTION, MIN, MAX) as the icon of the first row instead of opening gnuplot */
+    bool inline_plot;
 };
 
 } /* namespace rq */
@@ -25,13 +25,79 @@
 namespace rq::parsing
 {
 
+/** Parts of an assignment, pointing into the parsed expression */
 struct ParsedVariable
 {
-    std::string name;
-    std::string value;
+    std::string_view name;
+    std::string_view value;
 };
 
-std::optional<ParsedVariable> parse_variable_parts(std::string_view const & expression_input);
+std::optional<ParsedVariable> parse_variable_parts(std::string_view const & expression);
+
+/** Parts of a range query, e.g. "x^2 for x = 1..10", pointing into the parsed expression */
+struct ParsedRange
+{
+    std::string_view expression;
+    std::string_view variable;
+    long first;
+    long last;
+};
+
+/** Splits "EXPR for VAR = A..B" with integer A <= B, nullopt for anything else */
+std::optional<ParsedRange> parse_range_query(std::string_view const & expression);
+
+/** Arguments of a plot query, e.g. "plot(sin(x), -pi, pi)", pointing into the parsed expression */
+struct ParsedPlot
+{
+    /** Function of x */
+    std::string_view function;
+    /** Bounds of x, both empty when they were left out */
+    std::string_view min;
+    std::string_view max;
+};
+
+/**
+ * Splits "plot(FUNCTION)" and "plot(FUNCTION, MIN, MAX)", arguments may be separated by ";" as well.
+ * nullopt for anything else, including plot() calls with more arguments and expressions around the call.
+ */
+std::optional<ParsedPlot> parse_plot_query(std::string_view const & expression);
+
+/**
+ * Whether a character can be part of a name (variable, unit, function) in an expression.
+ * Bytes of multi-byte UTF-8 sequences are accepted as-is, so "€" and "°C" are names too.
+ */
+constexpr bool is_identifier_char(char c)
+{
+    auto const uc = static_cast<unsigned char>(c);
+    return (uc >= 'a' && uc <= 'z') || (uc >= 'A' && uc <= 'Z') || (uc >= '0' && uc <= '9')
+        || uc == '_' || uc == '$' || uc >= 0x80;
+}
+
+/**
+ * Calls visitor for every name-like token in the expression.
+ * This is a textual scan only, it doesn't know about libqalculate's definitions.
+ * @param visitor Called with each identifier, return false to stop the scan
+ */
+template <typename Visitor>
+constexpr void for_each_identifier(std::string_view const & expression, Visitor && visitor)
+{
+    size_t pos = 0;
+    while (pos < expression.length()) {
+        char const c = expression[pos];
+        if (!is_identifier_char(c) || (c >= '0' && c <= '9')) {
+            pos += 1;
+            continue;
+        }
+
+        size_t const start = pos;
+        while (pos < expression.length() && is_identifier_char(expression[pos])) {
+            pos += 1;
+        }
+        if (!visitor(expression.substr(start, pos - start))) {
+            return;
+        }
+    }
+}
 
 }
 
@@ -0,0 +1,55 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "plot_samples.h"
+
+#include <memory>
+
+typedef struct _cairo_surface cairo_surface_t;
+
+namespace rq
+{
+
+/**
+ * Plot of the last result drawn with cairo, shown as the icon of a row.
+ * The surface is kept until the samples or the size change, rofi asks for icons on every redraw.
+ */
+class PlotIcon
+{
+public:
+    PlotIcon() = default;
+    PlotIcon(PlotIcon const &) = delete;
+    PlotIcon & operator=(PlotIcon const &) = delete;
+    ~PlotIcon();
+
+    /**
+     * Icon of the samples, drawn size by size pixels.
+     * @return Surface owned by PlotIcon, valid until the next call or clear(). nullptr if it couldn't be created
+     */
+    cairo_surface_t * get(std::shared_ptr<PlotSamples const> const & samples, unsigned size);
+    void clear();
+
+private:
+    std::shared_ptr<PlotSamples const> _samples;
+    unsigned _size = 0;
+    cairo_surface_t * _surface = nullptr;
+};
+
+} /* namespace rq */
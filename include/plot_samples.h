@@ -0,0 +1,69 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "parsing.h"
+
+#include <memory>
+#include <vector>
+
+class Calculator;
+struct EvaluationOptions;
+
+namespace rq
+{
+
+/**
+ * Function of a plot() query, sampled to be drawn in-process instead of by gnuplot,
+ * see Options::inline_plot.
+ */
+struct PlotSamples
+{
+    struct Point
+    {
+        double x;
+        /** NaN where the function has no real value */
+        double y;
+    };
+
+    /** Evenly spaced over x_min...x_max, in increasing x */
+    std::vector<Point> points;
+    double x_min;
+    double x_max;
+    /** Range of the real values, both NaN if there are none */
+    double y_min;
+    double y_max;
+};
+
+/** Samples of the first pass, shown while typing */
+static constexpr int COARSE_PLOT_STEPS = 32;
+/** Samples of the second pass, once the query has stayed the same for a moment */
+static constexpr int PLOT_STEPS = 256;
+
+/**
+ * Samples the function of a plot query with libqalculate's batch evaluator,
+ * MathStructure::generateVector(). The function is evaluated symbolically once and x is then
+ * substituted, which is what libqalculate does for gnuplot as well.
+ * @param steps Number of steps between the bounds, x_min = 0 and x_max = 10 if the query leaves them out
+ * @return nullptr if the bounds aren't real numbers or sampling timed out
+ */
+std::shared_ptr<PlotSamples const> sample_plot(Calculator & calc, parsing::ParsedPlot const & plot, int steps,
+                                               int timeout_ms, EvaluationOptions const & eo);
+
+} /* namespace rq */
@@ -18,58 +18,74 @@
  */
 #pragma once
 
+#include "history.h"
+#include "history_archive.h"
+#include "history_dependencies.h"
 #include "options.h"
 #include "qalc_thread.h"
+#include "variables_file.h"
 
+#include <deque>
 #include <future>
-#include <sstream>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #ifndef ROFIQALC_MODE_NAME
 #define ROFIQALC_MODE_NAME "qalc"
 #endif
 
-class KnownVariable;
+struct PrintOptions;
 
 namespace rq
 {
 
-struct HistoryEntry
-{
-    std::string expression;
-    std::string result;
-    /** Indicates whether the history entry should be persistent (stored in the history file) */
-    bool persistent;
-    /** Indicates whether the history entry is an assignment (lacking a result) */
-    bool is_assignment;
-
-    [[nodiscard]]
-    std::string print() const
-    {
-        std::stringstream ss;
-        ss << expression;
-        if (!is_assignment) {
-            ss << separator << result;
-        }
-        return ss.str();
-    }
-
-    static constexpr std::string_view separator = " = ";
-};
-
 class RofiQalc
 {
 public:
+    /** Sets up the calculator, its thread isn't started until start() */
     RofiQalc();
     ~RofiQalc();
 
-    void append_result_to_history(bool persistent=true);
+    /** Starts the calculator thread, from then on only that thread uses libqalculate */
+    void start();
+
+    void append_result_to_history(bool persistent=true, std::string_view alternate_result={});
     void erase_history_line(int index);
+    /** Reads the history file, before start() since assignments in it are recognized through libqalculate */
     void load_history();
-    void save_history() const;
+    /** Writes the history file, entries that no longer fit in it go to the archive */
+    void save_history();
+    /** Logs the memory report, see Options::memory_report */
+    void log_memory_report();
+
+    /**
+     * Looks for history entries containing the text, newest first, see history_matches().
+     * The archive is only searched if the entries in memory don't make up enough matches, once
+     * typing pauses and for text of at least ARCHIVE_SEARCH_MIN_LENGTH characters.
+     * @param callback Called once matches from the archive have been added
+     */
+    void search_history(std::string_view text, EvalCallback callback, void * userdata);
+
+    void end_history_search();
+
+    [[nodiscard]]
+    bool is_searching_history() const
+    {
+        return this->_is_searching_history;
+    }
+
+    /** Matches of the last search_history() call */
+    [[nodiscard]]
+    std::vector<HistoryEntry> const & history_matches() const
+    {
+        return this->_history_matches;
+    }
 
     void update_ans();
     void evaluate(std::string_view const & expr, EvalCallback callback, void * userdata);
@@ -86,35 +102,137 @@ public:
         return _thread_data.eval_in_progress.load();
     }
 
+    /** Whether the last result is an approximation the calculator thread is still refining */
+    [[nodiscard]]
+    bool is_refining()
+    {
+        return last_result().is_approximate && is_eval_in_progress();
+    }
+
+    /**
+     * Result of the last finished evaluate() call.
+     * Picks up a newer result from the calculator thread first, if there is one.
+     */
     [[nodiscard]]
-    constexpr std::string_view get_last_expression() const
+    EvalResult const & last_result()
     {
-        return _last_expr;
+        this->_thread_data.results.fetch();
+        return this->_thread_data.results.front();
     }
 
-    constexpr void clear_last_expression()
+    /**
+     * Result of the expression last passed to evaluate() from the result cache, until the calculator
+     * thread has finished evaluating it. nullptr if there's none, see Options::result_cache.
+     */
+    [[nodiscard]]
+    std::string const * cached_result();
+
+    /** Expression last passed to evaluate(), which may not have a result yet. Completion works on it */
+    [[nodiscard]]
+    std::string_view get_last_expression() const
     {
-        _last_expr.clear();
+        return this->_last_expression;
     }
 
+    void clear_last_expression()
+    {
+        this->_last_expression.clear();
+        this->_thread_data.results.fetch();
+        this->_thread_data.results.front().expression.clear();
+    }
+
+    /** Picks up newer alternate formats of the result, returns whether they changed */
+    bool fetch_alternate_results()
+    {
+        return this->_thread_data.alternate_results.fetch();
+    }
+
+    /** Alternate formats of the result, as of the last fetch_alternate_results() call */
+    [[nodiscard]]
+    std::vector<AlternateResult> const & alternate_results() const
+    {
+        return this->_thread_data.alternate_results.front().rows;
+    }
+
+    /**
+     * Completes the name at the end of the expression, to the matching name history uses most.
+     * @return Expression with the name completed, nullopt if there's nothing to complete
+     */
+    [[nodiscard]]
+    std::optional<std::string> complete_name(std::string_view expression);
+
+    /**
+     * Puts the results of history entries evaluated again into history, see Options::recompute_history,
+     * and the results printed in full for entries added abbreviated.
+     * @return Whether any entry changed
+     */
+    bool fetch_recomputed_history();
+
+    /**
+     * Picks up the rows of the last result, see EvalResult::rows.
+     * The rows shown before go back to the calculator thread, they hold libqalculate's structures.
+     */
+    void fetch_result_rows();
+
+    /** Number of result rows, as of the last fetch_result_rows() call */
+    [[nodiscard]]
+    size_t result_row_count() const
+    {
+        return this->_result_rows != nullptr ? this->_result_rows->size() : 0;
+    }
+
+    /**
+     * Result row, as of the last fetch_result_rows() call.
+     * @return nullptr until the calculator thread has printed the row, it calls callback once it has
+     */
+    [[nodiscard]]
+    std::string const * result_row(size_t index, EvalCallback callback, void * userdata);
+
 public:
     /** Command-line options for the mode */
     Options options;
     /** History contents */
-    std::vector<HistoryEntry> history;
-
-    /** Result of the last successful evaluate() call */
-    std::string previous_result;
-    /** Messages generated during the last evaluate() call */
-    std::vector<LogMessage> previous_messages;
+    History history { options.deduplicate_history };
 
     /** Ugly hack, see usage rofi_shim.cpp */
     std::future<void> textbox_clear_fut;
 
 protected:
     static void _calculator_thread_entry(ThreadData & data);
+    /** Options results are printed with */
+    static PrintOptions _result_print_options();
+    static int _exchange_rates_idle_cb(void * userdata);
+    static int _archive_search_cb(void * userdata);
+
+    /** Free command slot to fill in before _push_command(), one outside the queue if that's full */
+    CalculatorCommand & _next_command();
+    /** Hands the command from _next_command() over to the calculator thread */
+    void _push_command();
+    /**
+     * Moves commands that didn't fit in the queue into it, as far as there's room.
+     * @return Whether all of them have been moved
+     */
+    bool _flush_commands();
+    static int _flush_commands_cb(void * userdata);
+    void _notify_calculator_thread();
+    void _arm_exchange_rates_timer();
 
-    void _load_history_variable_into_qalculate(std::string const & history_line);
+    void _load_variables_into_qalculate(std::vector<VariableDefinition> const & variables);
+    /** Counts the names an expression from history uses, for ranking completions */
+    void _count_name_uses(std::string_view expression);
+    /** Removes the oldest history entry, keeping it for the archive if there is one */
+    void _evict_oldest_history_entry();
+    /** Adds a history entry, recording the names it uses if entries are recomputed */
+    HistoryEntry const & _append_history_entry(HistoryEntry entry);
+    /** Has the calculator thread print the abbreviated last result in full for the entry it was added as */
+    void _print_full_result(HistoryEntry const & entry);
+    /** Tells the result cache what results depend on besides the expression, see ResultCache::set_context() */
+    void _update_result_cache_context();
+    /** Hash of what results depend on besides the expression, from the variables file and definitions */
+    [[nodiscard]]
+    uint64_t _result_cache_context() const;
+    /** Has the history entries using a variable evaluated again, see Options::recompute_history */
+    void _recompute_history_using(std::string_view name);
 
 protected:
     /** Calculator thread */
@@ -122,13 +240,73 @@ protected:
     /** Data written to by the calculator thread */
     ThreadData _thread_data { options };
 
-    /** Last expression to be passed into evaluate() */
-    std::string _last_expr;
     /** Hash of the previous expression, used for skipping double-calculation */
     size_t _last_expr_hash = 0;
+    /** Expression of the last evaluate() call, last_result() may still be for an older one */
+    std::string _last_expression;
+    /** Callback of the last evaluate() call, recomputed history entries are announced through it as well */
+    EvalCallback _eval_callback = nullptr;
+    void * _eval_userdata = nullptr;
+
+    /** Source ID of the idle timer for loading exchange rates in the background, 0 if not armed */
+    unsigned _exchange_rates_timer = 0;
+    /** Commands that didn't fit in the queue, oldest first, see _flush_commands() */
+    std::deque<CalculatorCommand> _overflow_commands;
+    /** Whether the last _next_command() call returned a command in _overflow_commands */
+    bool _is_next_command_overflow = false;
+    /** Source ID of the timer retrying _flush_commands(), 0 if not armed */
+    unsigned _flush_commands_timer = 0;
+
+    /** Variables assigned through the mode, restored by load_history() */
+    VariablesFile _variables_file;
+    /** exchange_rates::source_stamp() at startup, part of the result cache's context */
+    int64_t _exchange_rates_stamp = 0;
+    /** Definition categories -definitions asks for, see definitions.h. Part of the result cache's context */
+    unsigned _definitions_categories = 0;
+    /** Expression of the last evaluate() call and its result from the result cache, if it had one */
+    std::string _cached_expression;
+    std::string _cached_result;
+    bool _has_cached_result = false;
+    /** Names of libqalculate's save function, for HistoryScanner */
+    std::vector<std::string> _save_keywords;
+
+    /** Older history entries, nullptr unless Options::history_archive is set */
+    std::unique_ptr<HistoryArchive> _history_archive;
+    /** Entries dropped from history since it was loaded, oldest first, archived by save_history() */
+    std::vector<HistoryEntry> _evicted_history;
+    bool _is_searching_history = false;
+    std::vector<HistoryEntry> _history_matches;
+    /** Source ID of the timer searching the archive for _archive_search_text, 0 if not armed */
+    unsigned _archive_search_timer = 0;
+    std::string _archive_search_text;
+    EvalCallback _archive_search_callback = nullptr;
+    void * _archive_search_userdata = nullptr;
+    /** Names history entries use, nullptr unless Options::recompute_history is set */
+    std::unique_ptr<HistoryDependencies> _history_dependencies;
+    /** Recomputed entries taken from the calculator thread, kept for its capacity */
+    std::vector<HistoryEntry> _recomputed_history;
+    /** Entries with their result printed in full taken from the calculator thread, kept for its capacity */
+    std::vector<HistoryEntry> _full_results;
+    /**
+     * Entries added with the same abbreviated result as an entry it's being printed for,
+     * as (id of that entry, id of the entry to copy it to) pairs
+     */
+    std::vector<std::pair<unsigned, unsigned>> _full_result_copies;
+    /** Rows of the result being shown, kept alive while they're shown */
+    std::shared_ptr<ResultRows> _result_rows;
+
+    struct NameHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view name) const
+        {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
 
-    /** ansn variables used in libqalc Calculator */
-    KnownVariable * _var_ans[5];
+    /** How often history uses each name */
+    std::unordered_map<std::string, unsigned, NameHash, std::equal_to<>> _name_uses;
 };
 
 } /* namespace rq */
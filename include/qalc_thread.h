@@ -19,41 +19,161 @@
 #pragma once
 
 #include "options.h"
+#include "completion_index.h"
+#include "definitions_index.h"
+#include "history.h"
 #include "log_message.h"
+#include "memory_report.h"
+#include "plot_samples.h"
+#include "result_cache.h"
+#include "expression_cache.h"
+#include "result_formats.h"
+#include "result_rows.h"
+#include "sandbox.h"
+#include "spsc_queue.h"
+#include "swap_buffer.h"
+#include "variables_file.h"
 
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
 class Calculator;
+class KnownVariable;
 class MathStructure;
 
 namespace rq
 {
 
-typedef void (*EvalCallback)(std::string const & result,
-                             std::vector<LogMessage> const & error, void * userdata);
+/** Called from the calculator thread after an evaluation result has been published */
+typedef void (*EvalCallback)(void * userdata);
 
-struct ExpressionQuery
+enum class CommandType
 {
-    /** Expression to calculate */
+    /** Evaluate an expression, only the newest of the pending evaluations is done */
+    EVALUATE,
+    /** Add or redefine variables */
+    ADD_VARIABLES,
+    /** Delete a variable */
+    DELETE_VARIABLE,
+    /** Shift the ans variables and assign the last result to ans */
+    ROTATE_ANS,
+    /** Load exchange rates, unless they have been loaded already */
+    LOAD_EXCHANGE_RATES,
+    /** Print a chunk of result rows, see ResultRows */
+    GENERATE_ROWS,
+    /** Evaluate history entries again, a variable they use has changed */
+    RECOMPUTE_HISTORY,
+    /** Print an abbreviated result in full, for the history entry it was added as */
+    PRINT_FULL_RESULT,
+    /** Drop rows the main thread doesn't show anymore, so they're destroyed on the calculator thread */
+    RELEASE_ROWS,
+};
+
+/** Request from the main thread to the calculator thread */
+struct CalculatorCommand
+{
+    CommandType type = CommandType::EVALUATE;
+    /** EVALUATE: expression to calculate */
     std::string expression;
-    /** Callback to call after evaluation is finished successfully */
+    /**
+     * EVALUATE, GENERATE_ROWS, RECOMPUTE_HISTORY, PRINT_FULL_RESULT: callback to call after the
+     * result, the rows or a history entry are published
+     */
     EvalCallback callback = nullptr;
-    /** User data passed to callback */
+    /** EVALUATE, GENERATE_ROWS, RECOMPUTE_HISTORY, PRINT_FULL_RESULT: user data passed to callback */
     void * userdata = nullptr;
+    /** ADD_VARIABLES: variables to add */
+    std::vector<VariableDefinition> variables;
+    /** DELETE_VARIABLE: name of the variable */
+    std::string name;
+    /**
+     * DELETE_VARIABLE: result cache context without the variable, see ResultCache::set_context().
+     * The cache is disabled if there's none, the context doesn't cover the variable.
+     */
+    std::optional<uint64_t> result_cache_context;
+    /** GENERATE_ROWS: rows to print a chunk of. RELEASE_ROWS: rows to drop */
+    std::shared_ptr<ResultRows> rows;
+    /** GENERATE_ROWS: index of a row in the chunk */
+    size_t row = 0;
+    /** RECOMPUTE_HISTORY: entries to evaluate again. PRINT_FULL_RESULT: the entry to print the result for */
+    std::vector<HistoryEntry> entries;
+    /** PRINT_FULL_RESULT: result to print, destroyed on the calculator thread along with the command */
+    std::unique_ptr<MathStructure> unprinted_result;
+};
+
+struct EvalResult
+{
+    /** Expression that was evaluated */
+    std::string expression;
+    /** Printed result, empty if evaluation failed */
+    std::string result;
+    /** Messages generated during evaluation */
+    LogMessages messages;
+    /** Whether the result is an approximation, see Options::progressive_eval_ms */
+    bool is_approximate = false;
+    /** Whether the expression was an assignment, those are added to history without their result */
+    bool is_assignment = false;
+    /** Whether result was abbreviated, see Options::max_result_digits */
+    bool is_abbreviated = false;
+    /** Full printed result, if it had to be printed before abbreviating it */
+    std::string full_result;
+    /**
+     * Result to print in full on demand, otherwise. Only meaningful when is_abbreviated is set.
+     * The main thread hands it back to the calculator thread to print, see CommandType::PRINT_FULL_RESULT.
+     */
+    std::unique_ptr<MathStructure> unprinted_result;
+    /** History entry unprinted_result is being printed in full for, 0 if none */
+    unsigned full_result_entry = 0;
+    /** Values of a vector or range result as rows, nullptr for other results */
+    std::shared_ptr<ResultRows> rows;
+    /** Samples of a plot drawn in-process, nullptr for other results, see Options::inline_plot */
+    std::shared_ptr<PlotSamples const> plot;
+};
+
+struct AlternateResult
+{
+    /** Format the result was printed in */
+    ResultFormat const * format;
+    /** Printed result */
+    std::string text;
+};
+
+struct AlternateResults
+{
+    std::vector<AlternateResult> rows;
 };
 
 struct ThreadData
 {
+    /** Starts no threads, so the sandbox can be forked after construction, see Sandbox */
     explicit ThreadData(Options const & options);
 
-    /** The libqalculate calculator stucture */
+    /** Memory used per phase, first so the calculator's construction is its first phase */
+    MemoryReport memory_report;
+    /**
+     * The libqalculate calculator stucture.
+     * Only accessed from the calculator thread once it's running, the main thread sends commands.
+     * Everything else of libqalculate's, MathStructures included, is created and destroyed on that
+     * thread as well, the main thread only gets printed text.
+     */
     std::unique_ptr<Calculator> calc;
-    /** Last calculated result */
+    /** Last calculated result, only accessed from the calculator thread */
     std::unique_ptr<MathStructure> last_result;
+    /**
+     * Evaluated expression before its conversion, so another conversion of the same expression only
+     * has to convert. Only accessed from the calculator thread.
+     */
+    std::unique_ptr<MathStructure> base_result;
+    /** Unlocalized expression base_result was evaluated from, empty if there's none */
+    std::string base_expression;
+    /** definitions_generation base_result was evaluated in, it's stale once that changes */
+    unsigned base_generation = 0;
+    /** ans, ans2 ... ans5 variables in calc */
+    KnownVariable * var_ans[5] = {};
     /** Indicates whether GNUplot is currently open */
     bool is_plot_open = false;
     /** Indicates whether evaluation is currently in progress */
@@ -63,12 +183,64 @@ struct ThreadData
     /** Rofi mode options, so we don't have to pass a reference to RofiQalc to calc. thread */
     Options const & options;
 
-    /** Tracks whether queued_query contains new data */
+    /** Whether exchange rates have been loaded, only accessed from the calculator thread */
+    bool exchange_rates_loaded = false;
+    /**
+     * Global definition categories loaded so far, see definitions.h.
+     * Only accessed from the calculator thread once it's running.
+     */
+    unsigned definitions_loaded = 0;
+    /**
+     * Names of the global definition categories, so only those defining an unknown name are loaded.
+     * Only accessed from the calculator thread once it's running.
+     */
+    DefinitionsIndex definitions_index;
+
+    /**
+     * Bumped whenever variables or other definitions change, which invalidates parsed
+     * expressions. Only accessed from the calculator thread.
+     */
+    unsigned definitions_generation = 0;
+    /** Bumped for every evaluation taken from the queue, only accessed from the calculator thread */
+    unsigned latest_query = 0;
+    /** Rows of the latest result, chunks of older ones aren't printed. Only accessed from the calculator thread */
+    std::shared_ptr<ResultRows> current_rows;
+    /** Parsed expressions, only accessed from the calculator thread */
+    ExpressionCache expression_cache { 64 };
+
+    /** Wakes up the calculator thread, set after pushing commands */
     std::atomic<bool> has_new_data;
-    /** Mutex used to guard queued_query */
-    std::mutex mtx_queued_query;
-    /** Queued query, lock mtx_queued_query when accessing */
-    ExpressionQuery queued_query;
+    /** Commands from the main thread, in the order they were given */
+    SpscQueue<CalculatorCommand, 64> commands;
+    /** Evaluation results for the main thread */
+    SwapBuffer<EvalResult> results;
+
+    /** Names to complete, rebuilt whenever definitions_generation changes, see CompletionIndex */
+    SwapBuffer<CompletionIndex> completion_index;
+    /** definitions_generation the completion index was last built for, only accessed from the calculator thread */
+    unsigned indexed_generation = ~0u;
+
+    /** Formats from Options::result_formats */
+    std::vector<ResultFormat const *> result_formats;
+    /** Alternate formats of the last result, for the main thread */
+    SwapBuffer<AlternateResults> alternate_results;
+    /** History entries with a new result, for the main thread, see Options::recompute_history */
+    std::vector<HistoryEntry> recomputed_history;
+    /** History entries with their result printed in full, for the main thread, see CommandType::PRINT_FULL_RESULT */
+    std::vector<HistoryEntry> full_results;
+    /** Guards recomputed_history and full_results */
+    std::mutex mtx_recomputed_history;
+    /** PRINT_FULL_RESULT commands whose entry isn't in full_results yet, so saving history can wait for them */
+    std::atomic<unsigned> full_results_pending = 0;
+    /**
+     * Results of earlier sessions, nullptr unless Options::result_cache is set.
+     * Looked up by the main thread, filled in by the calculator thread.
+     */
+    std::unique_ptr<ResultCache> result_cache;
+    /** Evaluation subprocess, nullptr unless Options::sandbox_eval is set */
+    std::unique_ptr<Sandbox> sandbox;
+    /** Reply buffer for sandbox, only accessed from the calculator thread */
+    SandboxReply sandbox_reply;
 };
 
 } // namespace rc
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace rq
+{
+
+/**
+ * Printed results of earlier sessions, kept in a memory-mapped file so they can be shown before
+ * the calculator gets to an expression.
+ *
+ * The file is an array of fixed-size slots, grouped into sets of WAYS slots. An expression can only
+ * be in the set its hash picks, a full set drops its least recently used slot. Expressions are
+ * normalized first, so "100 USD  to EUR" and " 100 USD to EUR" share a slot.
+ *
+ * Every slot carries the context it was stored under, a hash of whatever else the result depends
+ * on (variables, exchange rates, libqalculate's version), see set_context(). Slots of another
+ * context are never returned and get reused first.
+ *
+ * Read from the main thread and written from the calculator thread, a mutex keeps them apart.
+ * Every rofi process maps the same file, an flock() on it keeps them apart as well. Lookups don't
+ * wait for it, a slot another process is writing to is a miss.
+ */
+class ResultCache
+{
+public:
+    /** Slots per set */
+    static constexpr size_t WAYS = 4;
+
+    /**
+     * Opens the cache file, creating it or starting it over if it doesn't hold capacity slots.
+     * The cache stays empty if the file can't be mapped.
+     */
+    ResultCache(std::string const & path, size_t capacity);
+    ~ResultCache();
+
+    ResultCache(ResultCache const &) = delete;
+    ResultCache & operator=(ResultCache const &) = delete;
+
+    /** Hash of everything results depend on besides the expression, results of another context are missed */
+    void set_context(uint64_t context)
+    {
+        this->_context = context;
+    }
+
+    /** Context results evaluated now belong to, to be passed to store() along with them */
+    [[nodiscard]]
+    uint64_t context() const
+    {
+        return this->_context;
+    }
+
+    /**
+     * Stops lookups and stores for the rest of the session, for when the calculator has been changed
+     * in a way the context doesn't cover, e.g. by evaluating an assignment
+     */
+    void disable()
+    {
+        this->_disabled = true;
+    }
+
+    /**
+     * Looks up the result of an expression.
+     * @param result Receives the result on a hit
+     */
+    bool lookup(std::string_view expression, std::string & result);
+
+    /**
+     * Keeps the result of an expression, if they fit into a slot together.
+     * @param context context() when the expression was evaluated, it may have changed since
+     */
+    void store(std::string_view expression, std::string_view result, uint64_t context);
+
+    /**
+     * Whether the results of an expression only depend on what the context covers.
+     * Leaves out ans and names like now() or rand() that give something else every time.
+     */
+    static bool is_cacheable(std::string_view expression);
+
+private:
+    /** Start of the file */
+    struct Header
+    {
+        char magic[8];
+        uint32_t slot_count;
+        uint32_t reserved;
+        /** Bumped for every lookup and store, slots remember when they were last used */
+        uint64_t clock;
+    };
+
+    struct Slot
+    {
+        uint64_t hash;
+        uint64_t context;
+        /** Header::clock when the slot was last used, 0 if it's empty */
+        uint64_t last_used;
+        uint16_t expression_length;
+        uint16_t result_length;
+        /** Normalized expression followed by the result */
+        char text[228];
+    };
+    static_assert(sizeof(Slot) == 256);
+
+    /** Normalizes the expression into _key, returns its hash */
+    uint64_t _normalize(std::string_view expression);
+    /** First slot of the set the hash picks */
+    Slot * _set(uint64_t hash);
+
+    Header * _header = nullptr;
+    Slot * _slots = nullptr;
+    size_t _set_count = 0;
+    size_t _mapped_size = 0;
+    /** Cache file, kept open for flock() */
+    int _fd = -1;
+
+    std::atomic<uint64_t> _context = 0;
+    std::atomic<bool> _disabled = false;
+    /** Guards the mapped file and _key within the process */
+    std::mutex _mutex;
+    /** Scratch buffer for the normalized expression */
+    std::string _key;
+};
+
+} /* namespace rq */
@@ -0,0 +1,49 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <string>
+#include <string_view>
+
+class MathStructure;
+struct PrintOptions;
+
+namespace rq::result_display
+{
+
+/**
+ * Prints an exact integer result with more than max_digits digits as its leading digits and
+ * the digit count, e.g. "933262154439… (158 digits)". Only the leading digits are ever printed.
+ * A fraction whose numerator and denominator have more than max_digits digits together gets
+ * each of them abbreviated that way, when po prints fractions rather than decimals.
+ * @param out Receives the abbreviated result
+ * @return Whether the result was abbreviated, out is left alone if not
+ */
+bool print_abbreviated_number(MathStructure const & mstruct, PrintOptions const & po,
+                              unsigned max_digits, std::string & out);
+
+/**
+ * Abbreviates an already printed result longer than max_length bytes, keeping the start of it.
+ * Numbers get their digit count appended, anything else its length.
+ * @param out Receives the abbreviated result
+ * @return Whether the text was abbreviated, out is left alone if not
+ */
+bool abbreviate(std::string_view text, unsigned max_length, std::string & out);
+
+} /* namespace rq::result_display */
@@ -0,0 +1,40 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <string_view>
+
+struct PrintOptions;
+
+namespace rq
+{
+
+/** Alternative way of printing a result, shown as an extra row */
+struct ResultFormat
+{
+    /** Name used in the -result-formats option */
+    std::string_view name;
+    /** Adjusts the print options of the main result for this format */
+    void (*apply)(PrintOptions & po);
+};
+
+/** Looks up a format by its option name, nullptr if there is no such format */
+ResultFormat const * find_result_format(std::string_view const & name);
+
+} /* namespace rq */
@@ -0,0 +1,104 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Calculator;
+class MathStructure;
+struct EvaluationOptions;
+struct PrintOptions;
+
+namespace rq
+{
+
+/**
+ * Result that is a sequence of values, shown as a row per value.
+ *
+ * Rows are printed a chunk at a time once rofi wants to show them, so a huge vector or range
+ * doesn't get printed as a whole. The main thread looks up rows and requests the chunks that
+ * are missing, the calculator thread prints those and publishes them.
+ * The values are libqalculate structures, so the main thread hands its reference back to the
+ * calculator thread for the rows to be destroyed there, see CommandType::RELEASE_ROWS.
+ */
+class ResultRows
+{
+public:
+    static constexpr size_t CHUNK_SIZE = 32;
+
+    /** Rows of the elements of a vector, a matrix has one per matrix row */
+    static std::shared_ptr<ResultRows> from_vector(MathStructure const & vector);
+
+    /**
+     * Rows of expression evaluated for each value of a range, variable being first, first + 1 ...
+     * @param variable Structure of the variable in expression, replaced by the value
+     */
+    static std::shared_ptr<ResultRows> from_range(MathStructure const & expression, MathStructure const & variable,
+                                                  std::string_view variable_name, long first, size_t count);
+
+    ~ResultRows();
+
+    ResultRows(ResultRows const &) = delete;
+    ResultRows & operator=(ResultRows const &) = delete;
+
+    [[nodiscard]]
+    size_t size() const
+    {
+        return this->_size;
+    }
+
+    /** Printed row, nullptr if its chunk hasn't been published yet. Main thread only */
+    [[nodiscard]]
+    std::string const * row(size_t index) const;
+
+    /** Marks the chunk of a row as requested, returns false if it had been already. Main thread only */
+    bool request(size_t index);
+
+    /** Prints a row, evaluating it first for ranges. Calculator thread only */
+    [[nodiscard]]
+    std::string print_row(Calculator & calc, size_t index, int timeout_ms,
+                          EvaluationOptions const & eo, PrintOptions const & po) const;
+
+    /** Makes a chunk of rows printed by print_row() available to row() */
+    void publish(size_t chunk, std::vector<std::string> rows);
+
+private:
+    explicit ResultRows(size_t size);
+
+    size_t _size;
+    /** Vector for from_vector(), expression for from_range() */
+    std::unique_ptr<MathStructure> _values;
+    /** Variable of from_range(), nullptr for vectors */
+    std::unique_ptr<MathStructure> _variable;
+    std::string _variable_name;
+    long _first = 0;
+
+    /** Guards _chunks, written by the calculator thread */
+    mutable std::mutex _mtx;
+    /** Published chunks, nullptr until then. A chunk isn't changed after it's published */
+    std::vector<std::unique_ptr<std::vector<std::string> const>> _chunks;
+    std::vector<bool> _requested;
+};
+
+} /* namespace rq */
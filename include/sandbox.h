@@ -0,0 +1,112 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include "log_message.h"
+
+#include <string>
+#include <sys/types.h>
+
+class Calculator;
+struct PrintOptions;
+
+namespace rq
+{
+
+class DefinitionsIndex;
+
+struct SandboxReply
+{
+    /** Printed result, empty if evaluation failed */
+    std::string result;
+    /** Result printed so it can be parsed back, for ans variables */
+    std::string parsable_result;
+    /** Messages generated during evaluation */
+    LogMessages messages;
+    /** Whether libqalculate's own timeout hit */
+    bool timed_out = false;
+};
+
+enum class SandboxStatus
+{
+    /** The worker replied */
+    OK,
+    /** The worker overran its time budget and was killed */
+    KILLED,
+    /** The worker died, most likely by hitting its memory or CPU limit */
+    CRASHED,
+    /** There is no worker to evaluate with */
+    FAILED,
+};
+
+/**
+ * Evaluates expressions in a worker subprocess, so a runaway evaluation can be killed instead of
+ * taking rofi down with it.
+ *
+ * The constructor forks a zygote process while the calculator is freshly loaded and hasn't
+ * evaluated anything yet. Workers are forked from the zygote, so each starts from that clean
+ * state, and run with address space and CPU time limits. A worker which doesn't reply in time is
+ * killed and replaced.
+ *
+ * fork() only copies the calling thread, so the sandbox has to be constructed before any other
+ * thread that uses the calculator is started. Otherwise the zygote could get a copy of libqalculate
+ * state another thread was in the middle of changing.
+ *
+ * Variables of the calculator (history variables, ans etc.) are sent to the worker along with
+ * each expression. Only used from the calculator thread after construction.
+ */
+class Sandbox
+{
+public:
+    /**
+     * @param definitions_loaded Definition categories loaded into calc, see definitions.h
+     * @param definitions_index Names of the definition categories, copied into the workers
+     * @param memory_limit_mb Address space limit of the workers, 0 for none
+     */
+    Sandbox(Calculator & calc, PrintOptions const & po, unsigned definitions_loaded,
+            DefinitionsIndex const & definitions_index, unsigned memory_limit_mb);
+    ~Sandbox();
+
+    Sandbox(Sandbox const &) = delete;
+    Sandbox & operator=(Sandbox const &) = delete;
+
+    /**
+     * Evaluates an expression in the worker.
+     * @param print_parsed Whether the result is printed from the calculated structure
+     * @param timeout_ms libqalculate's timeout for each evaluation step
+     * @param kill_after_ms Time after which the worker is killed
+     */
+    SandboxStatus evaluate(Calculator & calc, std::string const & expression, bool print_parsed,
+                           int timeout_ms, int kill_after_ms, SandboxReply & reply);
+
+private:
+    bool _spawn_worker();
+    void _kill_worker();
+
+    /** Socket to the zygote, -1 if it couldn't be started */
+    int _control_fd = -1;
+    pid_t _zygote_pid = -1;
+    /** Socket to the current worker, -1 if there is none */
+    int _worker_fd = -1;
+    pid_t _worker_pid = -1;
+    /** Buffer for encoding requests and receiving replies */
+    std::string _buffer;
+};
+
+} /* namespace rq */
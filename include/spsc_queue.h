@@ -0,0 +1,84 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace rq
+{
+
+/**
+ * Lock-free bounded queue from one producer thread to one consumer thread.
+ *
+ * Like SwapBuffer the slots are recycled as-is: the producer fills in back() and hands it over
+ * with push(), the consumer reads the pushed slots in place and releases them with pop(). The
+ * producer should overwrite every member of back() it uses, strings and vectors in the slots
+ * keep their capacity.
+ */
+template <typename T, size_t CAPACITY>
+class SpscQueue
+{
+public:
+    /** Slot to fill in before push(), nullptr if the queue is full. Producer only */
+    [[nodiscard]]
+    T * back()
+    {
+        size_t const tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == CAPACITY) {
+            return nullptr;
+        }
+        return &_slots[tail % CAPACITY];
+    }
+
+    /** Hands back() over to the consumer, producer only */
+    void push()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /** Number of pushed slots the consumer hasn't popped yet, consumer only */
+    [[nodiscard]]
+    size_t size() const
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_relaxed);
+    }
+
+    /** Pushed slot, 0 being the oldest one. Must be below size(), consumer only */
+    [[nodiscard]]
+    T & operator[](size_t index)
+    {
+        return _slots[(_head.load(std::memory_order_relaxed) + index) % CAPACITY];
+    }
+
+    /** Releases the oldest slot back to the producer, consumer only */
+    void pop()
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    T _slots[CAPACITY] {};
+    /** Index of the oldest pushed slot, written by the consumer */
+    alignas(64) std::atomic<size_t> _head = 0;
+    /** Index of the next slot to push, written by the producer */
+    alignas(64) std::atomic<size_t> _tail = 0;
+};
+
+} /* namespace rq */
@@ -0,0 +1,96 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <atomic>
+
+namespace rq
+{
+
+/**
+ * Lock-free handoff of the latest value from one producer thread to one consumer thread.
+ *
+ * Double buffering plus a spare slot: the producer fills back() and swaps it with the spare
+ * slot in publish(), the consumer swaps the spare slot with front() in fetch() when something
+ * new was published. Neither side ever waits for the other, values that the consumer didn't
+ * get to in time are overwritten, and nothing is copied between the threads.
+ *
+ * Slots are recycled as-is, so the producer should overwrite or clear() every member of back()
+ * it uses -- in exchange strings and vectors in the slots keep their capacity.
+ */
+template <typename T>
+class SwapBuffer
+{
+public:
+    /** Slot to fill in before publish(), producer only */
+    [[nodiscard]]
+    T & back()
+    {
+        return _slots[_back];
+    }
+
+    /** Hands back() over to the consumer, back() then refers to a recycled slot */
+    void publish()
+    {
+        unsigned const previous = _spare.exchange(_back | FRESH, std::memory_order_acq_rel);
+        _back = previous & INDEX_MASK;
+    }
+
+    /**
+     * Picks up the latest published value into front(), consumer only.
+     * @return Whether front() changed
+     */
+    bool fetch()
+    {
+        if ((_spare.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        unsigned const previous = _spare.exchange(_front, std::memory_order_acq_rel);
+        _front = previous & INDEX_MASK;
+        return true;
+    }
+
+    /** Latest value picked up by fetch(), consumer only */
+    [[nodiscard]]
+    T & front()
+    {
+        return _slots[_front];
+    }
+
+    [[nodiscard]]
+    T const & front() const
+    {
+        return _slots[_front];
+    }
+
+private:
+    static constexpr unsigned INDEX_MASK = 0x3;
+    /** Set in _spare when it holds a value that the consumer hasn't fetched yet */
+    static constexpr unsigned FRESH = 0x4;
+
+    T _slots[3] {};
+    /** Slot owned by the producer */
+    unsigned _back = 0;
+    /** Slot owned by the consumer */
+    unsigned _front = 1;
+    /** Slot in transit, plus the FRESH flag */
+    std::atomic<unsigned> _spare = 2;
+};
+
+} /* namespace rq */
@@ -0,0 +1,200 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <utility>
+
+namespace rq
+{
+
+/** Task priority classes, most urgent first */
+enum class Priority
+{
+    /** Evaluating what's being typed */
+    INTERACTIVE,
+    /** Work following up on an interactive result, e.g. alternate formats or exact results */
+    DERIVED,
+    /** Anything that can wait, e.g. loading definitions */
+    BACKGROUND,
+};
+
+/**
+ * Coroutine run by TaskScheduler.
+ * Created suspended, it starts once the scheduler gets to it.
+ */
+class Task
+{
+public:
+    struct promise_type
+    {
+        Task get_return_object()
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+
+        Priority priority = Priority::INTERACTIVE;
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task(Task && other) noexcept
+        : _handle(std::exchange(other._handle, nullptr))
+    {
+    }
+
+    Task & operator=(Task &&) = delete;
+
+    ~Task()
+    {
+        if (this->_handle) {
+            this->_handle.destroy();
+        }
+    }
+
+    /** Hands the coroutine over to the caller */
+    Handle release()
+    {
+        return std::exchange(this->_handle, nullptr);
+    }
+
+private:
+    explicit Task(Handle handle)
+        : _handle(handle)
+    {
+    }
+
+    Handle _handle;
+};
+
+/**
+ * Cooperative scheduler for tasks on a single thread.
+ *
+ * The most urgent ready task runs until it finishes or reaches a co_await yield(), where it lets
+ * more urgent tasks go first. Tasks of the same priority run in the order they were spawned.
+ */
+class TaskScheduler
+{
+public:
+    class YieldAwaiter
+    {
+    public:
+        bool await_ready();
+        void await_suspend(Task::Handle handle);
+
+        void await_resume()
+        {
+        }
+
+    private:
+        friend class TaskScheduler;
+
+        YieldAwaiter(TaskScheduler & scheduler, Priority priority)
+            : _scheduler(scheduler)
+            , _priority(priority)
+        {
+        }
+
+        TaskScheduler & _scheduler;
+        Priority _priority;
+    };
+
+    TaskScheduler() = default;
+    ~TaskScheduler();
+
+    TaskScheduler(TaskScheduler const &) = delete;
+    TaskScheduler & operator=(TaskScheduler const &) = delete;
+
+    /**
+     * Called at every yield point, before checking for more urgent tasks.
+     * Lets the owner spawn tasks for work that has come in since.
+     */
+    void set_poll(std::function<void()> poll);
+
+    /**
+     * Runs BACKGROUND tasks with the thread's scheduling policy set to SCHED_IDLE.
+     * Whoever hands the thread more urgent work should call raise_from_idle(), otherwise the
+     * BACKGROUND task may not get to its next yield point while other processes keep the CPU busy.
+     * @see can_use_idle_policy()
+     */
+    void set_idle_background(bool idle_background);
+
+    void spawn(Priority priority, Task task);
+
+    /**
+     * Runs the most urgent ready task until it yields or finishes.
+     * @return False if there were no tasks to run
+     */
+    bool run_next();
+
+    /** Continues the running task at its current priority, once more urgent tasks have run */
+    [[nodiscard]]
+    YieldAwaiter yield();
+
+    /** Like yield(), but continues the running task at a different priority from now on */
+    [[nodiscard]]
+    YieldAwaiter yield(Priority priority);
+
+    /**
+     * Whether threads can switch to SCHED_IDLE and back to SCHED_OTHER.
+     * Tried on a throwaway thread, switching back needs a high enough RLIMIT_NICE.
+     */
+    static bool can_use_idle_policy();
+
+    /**
+     * Switches a thread running a BACKGROUND task at SCHED_IDLE back to SCHED_OTHER, so the task
+     * gets to its next yield point. Called from another thread, harmless if it isn't at SCHED_IDLE.
+     */
+    static void raise_from_idle(std::thread & thread);
+
+private:
+    /** Whether a task more urgent than priority is ready */
+    bool _has_more_urgent(Priority priority) const;
+
+    std::deque<Task::Handle> _ready[3];
+    /** Task being run by run_next() */
+    Task::Handle _running;
+    std::function<void()> _poll;
+    bool _idle_background = false;
+};
+
+} /* namespace rq */
@@ -0,0 +1,83 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rq
+{
+
+struct VariableDefinition
+{
+    std::string name;
+    /** Expression the variable is defined as, in the same form as it was assigned */
+    std::string value;
+};
+
+/**
+ * Snapshot of the variables assigned through the mode, so they can be restored without
+ * replaying the history file.
+ *
+ * Each line is "name := value", an empty value removes the variable. Changes are appended to
+ * the file as they happen and later lines override earlier ones. load() rewrites the file with
+ * only the latest definitions once it's mostly made up of overridden lines.
+ */
+class VariablesFile
+{
+public:
+    explicit VariablesFile(std::string path);
+    ~VariablesFile();
+
+    VariablesFile(VariablesFile const &) = delete;
+    VariablesFile & operator=(VariablesFile const &) = delete;
+
+    /**
+     * Reads the file in one pass, replacing variables().
+     * @return False if there is no file yet
+     */
+    bool load();
+
+    /** Defines or redefines a variable and appends it to the file */
+    void set(std::string_view name, std::string_view value);
+    /** Removes a variable and appends the removal to the file */
+    void remove(std::string_view name);
+
+    /** Latest definition of every variable, in the order they were last defined */
+    [[nodiscard]]
+    std::vector<VariableDefinition> const & variables() const
+    {
+        return this->_variables;
+    }
+
+private:
+    /** Updates variables() without touching the file, an empty value removes the variable */
+    void _apply(std::string_view name, std::string_view value);
+    void _append_line(std::string_view name, std::string_view value);
+    void _rewrite();
+
+    std::string _path;
+    std::vector<VariableDefinition> _variables;
+    /** File opened for appending, nullptr until the first change */
+    std::FILE * _file = nullptr;
+};
+
+} /* namespace rq */
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Builds a plain optimized (LTO) and a profile-trained (LTO + PGO) rofi-qalc,
+# then runs the benchmark against both so they can be compared.
+
+set -e
+
+if [ "$#" -ne 0 ] && [ "$#" -ne 2 ]; then
+    echo "Usage: $0 [plain-builddir pgo-builddir]"
+    exit 1
+fi
+
+srcdir="$(cd "$(dirname "$0")/.." && pwd)"
+plain="${1:-build-plain}"
+pgo="${2:-build-pgo}"
+corpus="$srcdir/bench/corpus"
+options="--buildtype=release -Db_lto=true -Dbench=true"
+
+meson setup $options "$plain" "$srcdir"
+meson compile -C "$plain"
+
+# Stage 1: instrumented build, profiles are written next to the objects when rq-bench exits
+meson setup $options -Db_pgo=generate "$pgo" "$srcdir"
+meson compile -C "$pgo"
+"$pgo/rq-bench" --train "$corpus"
+
+# Stage 2: rebuild using the recorded profiles
+meson configure -Db_pgo=use "$pgo"
+meson compile -C "$pgo"
+
+echo "== $plain (LTO)"
+"$plain/rq-bench" "$corpus"
+echo "== $pgo (LTO + PGO)"
+"$pgo/rq-bench" "$corpus"
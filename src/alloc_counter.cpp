@@ -0,0 +1,115 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "alloc_counter.h"
+
+#ifdef RQ_ALLOC_COUNTING
+
+#include <cstdlib>
+#include <new>
+#include <glib.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+/*
+ * Thread-locals with constant initialization only, anything needing a constructor could
+ * allocate from inside operator new.
+ */
+static thread_local alloc_counter::Counts counts;
+static thread_local unsigned external_depth = 0;
+
+static void count_allocation()
+{
+    if (external_depth > 0) {
+        counts.external += 1;
+    } else {
+        counts.own += 1;
+    }
+}
+
+alloc_counter::Counts alloc_counter::thread_counts()
+{
+    return counts;
+}
+
+void alloc_counter::log_since(char const * what, Counts const & start)
+{
+    g_info("%s: %" G_GUINT64_FORMAT " allocations, %" G_GUINT64_FORMAT " more in libqalculate",
+        what, counts.own - start.own, counts.external - start.external);
+}
+
+alloc_counter::ExternalScope::ExternalScope()
+{
+    external_depth += 1;
+}
+
+alloc_counter::ExternalScope::~ExternalScope()
+{
+    external_depth -= 1;
+}
+
+/*
+ * Replacements of the global allocation functions. The remaining variants (nothrow, array)
+ * are implemented by the standard library in terms of these.
+ */
+
+void * operator new(std::size_t size)
+{
+    count_allocation();
+    if (void * ptr = std::malloc(size == 0 ? 1 : size); ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment)
+{
+    count_allocation();
+    auto const align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants the size to be a non-zero multiple of the alignment
+    std::size_t const aligned_size = size == 0 ? align : (size + align - 1) / align * align;
+    if (void * ptr = std::aligned_alloc(align, aligned_size); ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void * ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
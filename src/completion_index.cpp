@@ -0,0 +1,57 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "completion_index.h"
+
+#include <algorithm>
+
+using namespace rq;
+
+void CompletionIndex::clear()
+{
+    this->_text.clear();
+    this->_names.clear();
+}
+
+void CompletionIndex::add(std::string_view name)
+{
+    if (name.empty()) {
+        return;
+    }
+    this->_names.push_back({static_cast<uint32_t>(this->_text.length()), static_cast<uint32_t>(name.length())});
+    this->_text.append(name);
+}
+
+void CompletionIndex::sort()
+{
+    auto const text = [this](Name const & name) {
+        return std::string_view{this->_text}.substr(name.offset, name.length);
+    };
+
+    std::ranges::sort(this->_names, {}, text);
+    auto const duplicates = std::ranges::unique(this->_names, {}, text);
+    this->_names.erase(duplicates.begin(), duplicates.end());
+}
+
+size_t CompletionIndex::_lower_bound(std::string_view prefix) const
+{
+    auto const it = std::ranges::lower_bound(this->_names, prefix, {}, [this](Name const & name) {
+        return std::string_view{this->_text}.substr(name.offset, name.length);
+    });
+    return it - this->_names.begin();
+}
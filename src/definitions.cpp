@@ -0,0 +1,238 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "definitions.h"
+#include "definitions_index.h"
+#include "definitions_snapshot.h"
+#include "memory_report.h"
+#include "parsing.h"
+
+#include <algorithm>
+#include <clocale>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libqalculate/qalculate.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+struct CategoryInfo
+{
+    definitions::Category category;
+    std::string_view name;
+    /** Categories whose definitions this one refers to */
+    unsigned dependencies;
+    bool (Calculator::*load)();
+};
+
+/** In the order libqalculate's loadGlobalDefinitions() loads them, dependencies come first */
+static constexpr CategoryInfo CATEGORIES[] = {
+    { definitions::PREFIXES, "prefixes", 0, &Calculator::loadGlobalPrefixes },
+    { definitions::CURRENCIES, "currencies", 0, &Calculator::loadGlobalCurrencies },
+    { definitions::UNITS, "units", definitions::PREFIXES, &Calculator::loadGlobalUnits },
+    { definitions::FUNCTIONS, "functions", 0, &Calculator::loadGlobalFunctions },
+    { definitions::DATASETS, "datasets", definitions::UNITS, &Calculator::loadGlobalDataSets },
+    { definitions::VARIABLES, "variables", definitions::UNITS, &Calculator::loadGlobalVariables },
+};
+
+/**
+ * Categories that may define the names in the expression libqalculate doesn't know.
+ * @param categories Categories to look in
+ * @param index Names of the categories, without one any category may define any name
+ */
+static unsigned find_unknown_names(Calculator & calc, std::string_view const & expression, unsigned categories,
+                                   DefinitionsIndex const * index)
+{
+    unsigned found = 0;
+
+    parsing::for_each_identifier(expression, [&](std::string_view const & identifier) {
+        std::string const name{identifier};
+        if (!definitions::is_known_name(calc, name)) {
+            found |= index != nullptr ? index->find(calc, name, categories) : categories;
+        }
+        return found != categories;
+    });
+
+    return found;
+}
+
+unsigned definitions::find_category(std::string_view const & name)
+{
+    for (auto const & info : CATEGORIES) {
+        if (info.name == name) {
+            return info.category;
+        }
+    }
+    return 0;
+}
+
+definitions::FileStamp definitions::file_stamp(unsigned category)
+{
+    FileStamp stamp;
+
+    for (auto const & info : CATEGORIES) {
+        if (info.category != category) {
+            continue;
+        }
+
+        std::string const basename = std::string{info.name} + ".xml";
+        gchar * filename = g_build_filename(getGlobalDefinitionsDir().c_str(), basename.c_str(), NULL);
+        GStatBuf st;
+        if (g_stat(filename, &st) == 0) {
+            stamp.mtime = st.st_mtime;
+            stamp.size = st.st_size;
+        }
+        g_free(filename);
+        break;
+    }
+
+    return stamp;
+}
+
+std::string definitions::message_locale()
+{
+    char const * locale = setlocale(LC_MESSAGES, nullptr);
+    char const * language = g_getenv("LANGUAGE");
+    std::string result{locale != nullptr ? locale : "C"};
+
+    if (language != nullptr && *language != '\0') {
+        result.append(":").append(language);
+    }
+    return result;
+}
+
+definitions::FileStamp definitions::local_stamp()
+{
+    FileStamp stamp;
+    gchar * dirname = g_build_filename(getLocalDataDir().c_str(), "definitions", NULL);
+
+    // The directory's own time changes when files are added, removed or renamed
+    GStatBuf st;
+    GDir * dir = g_dir_open(dirname, 0, nullptr);
+    if (dir != nullptr && g_stat(dirname, &st) == 0) {
+        stamp.mtime = st.st_mtime;
+        stamp.size = 0;
+        while (gchar const * name = g_dir_read_name(dir)) {
+            gchar * filename = g_build_filename(dirname, name, NULL);
+            if (g_stat(filename, &st) == 0) {
+                stamp.mtime = std::max<int64_t>(stamp.mtime, st.st_mtime);
+                stamp.size += st.st_size;
+            }
+            g_free(filename);
+        }
+    }
+    if (dir != nullptr) {
+        g_dir_close(dir);
+    }
+    g_free(dirname);
+
+    return stamp;
+}
+
+unsigned definitions::load(Calculator & calc, unsigned categories, unsigned loaded, DefinitionsIndex * index)
+{
+    // Dependencies always come earlier in the table, so a reverse pass resolves them transitively
+    for (auto it = std::rbegin(CATEGORIES); it != std::rend(CATEGORIES); ++it) {
+        if (categories & it->category) {
+            categories |= it->dependencies;
+        }
+    }
+
+    for (auto const & info : CATEGORIES) {
+        if (!(categories & info.category) || (loaded & info.category)) {
+            continue;
+        }
+
+        bool const is_indexed = index == nullptr || index->is_indexed(info.category);
+        auto const names_before = is_indexed ? std::vector<std::string>{} : DefinitionsIndex::collect_names(calc);
+
+        gint64 const start_us = g_get_monotonic_time();
+        long const start_rss_kib = MemoryReport::rss_kib();
+
+        // Prefixes, units and variables have snapshots, the other categories hold objects they can't recreate
+        bool const has_snapshot = definitions_snapshot::is_supported(info.category);
+        bool const from_snapshot = has_snapshot && definitions_snapshot::restore(calc, info.category);
+        if (!from_snapshot) {
+            auto const baseline = has_snapshot ? definitions_snapshot::take_baseline(calc)
+                : definitions_snapshot::Baseline{};
+            if (!(calc.*info.load)()) {
+                g_warning("Failed to load %s definitions", info.name.data());
+            } else if (has_snapshot) {
+                definitions_snapshot::write(calc, info.category, baseline);
+            }
+        }
+        // Not retried on failure, the definitions file won't appear by itself
+        loaded |= info.category;
+
+        long const rss_kib = MemoryReport::rss_kib();
+        g_info("Loaded %s definitions%s in %ld ms, resident memory +%ld KiB (%ld KiB total)",
+            info.name.data(), from_snapshot ? " from snapshot" : "",
+            (g_get_monotonic_time() - start_us) / 1000, rss_kib - start_rss_kib, rss_kib);
+
+        if (!is_indexed) {
+            index->record(calc, info.category, names_before);
+        }
+    }
+
+    return loaded;
+}
+
+unsigned definitions::load_for_expression(Calculator & calc, std::string_view const & expression, unsigned loaded,
+                                          DefinitionsIndex * index)
+{
+    for (auto const & info : CATEGORIES) {
+        if (loaded & info.category) {
+            continue;
+        }
+        // Looked up again after every category, it may have defined the names
+        unsigned const wanted = find_unknown_names(calc, expression, ALL & ~loaded, index);
+        if (wanted == 0) {
+            break;
+        }
+        if (!(wanted & info.category)) {
+            continue;
+        }
+        g_debug("Unknown name in \"%.*s\", loading %s definitions",
+            static_cast<int>(expression.size()), expression.data(), info.name.data());
+        loaded = load(calc, info.category, loaded, index);
+    }
+
+    return loaded;
+}
+
+bool definitions::is_known_name(Calculator & calc, std::string const & name)
+{
+    if (calc.getActiveExpressionItem(name) != nullptr) {
+        return true;
+    }
+
+    // Units with a prefix, e.g. "km", aren't definitions by themselves
+    for (size_t i = 1; i < name.size(); ++i) {
+        if (calc.getPrefix(name.substr(0, i)) != nullptr
+                && calc.getActiveUnit(name.substr(i)) != nullptr) {
+            return true;
+        }
+    }
+
+    return false;
+}
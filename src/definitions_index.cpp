@@ -0,0 +1,228 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "definitions_index.h"
+#include "binary_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <glib.h>
+#include <libqalculate/qalculate.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+using namespace rq::binary_io;
+
+/*
+ * Cache file layout, see binary_io.h for the encoding:
+ *   char[4] magic, u32 version, u32 libqalculate version, string message locale, u32 category count
+ *   categories: u32 category, i64 definitions file mtime, i64 definitions file size, u32 name count,
+ *               names as strings
+ */
+static constexpr char CACHE_MAGIC[4] = { 'R', 'Q', 'D', 'N' };
+static constexpr uint32_t CACHE_VERSION = 2;
+static constexpr uint32_t QALCULATE_VERSION =
+    QALCULATE_MAJOR_VERSION * 10000 + QALCULATE_MINOR_VERSION * 100 + QALCULATE_MICRO_VERSION;
+
+static gchar * get_cache_filename()
+{
+    return g_build_filename(g_get_user_cache_dir(), "rofi-qalc", "definition_names.cache", NULL);
+}
+
+static bool contains(std::vector<std::string> const & names, std::string_view name)
+{
+    return std::binary_search(names.begin(), names.end(), name);
+}
+
+void DefinitionsIndex::read()
+{
+    gchar * cache_file = get_cache_filename();
+    gchar * cache_data = nullptr;
+    gsize cache_size = 0;
+
+    if (g_file_get_contents(cache_file, &cache_data, &cache_size, nullptr)) {
+        std::string_view in{cache_data, cache_size};
+        uint32_t version;
+        uint32_t qalculate_version;
+        std::string_view locale;
+        uint32_t count;
+
+        bool ok = in.starts_with(std::string_view{CACHE_MAGIC, sizeof(CACHE_MAGIC)});
+        if (ok) {
+            in.remove_prefix(sizeof(CACHE_MAGIC));
+            ok = get(in, version) && version == CACHE_VERSION
+                && get(in, qalculate_version) && qalculate_version == QALCULATE_VERSION
+                // Names are translated while loading, the ones of another language don't load anything
+                && get_string(in, locale) && locale == definitions::message_locale()
+                && get(in, count);
+        }
+
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            uint32_t category;
+            definitions::FileStamp stamp;
+            uint32_t name_count;
+            ok = get(in, category) && std::has_single_bit(category) && (category & definitions::ALL)
+                && get(in, stamp.mtime) && get(in, stamp.size) && get(in, name_count);
+
+            Entry entry;
+            for (uint32_t j = 0; ok && j < name_count; ++j) {
+                std::string_view name;
+                ok = get_string(in, name);
+                entry.names.emplace_back(name);
+            }
+            // Names of a category whose definitions have changed may be out of date
+            if (ok && stamp == definitions::file_stamp(category)) {
+                entry.is_indexed = true;
+                entry.mtime = stamp.mtime;
+                entry.size = stamp.size;
+                std::ranges::sort(entry.names);
+                this->_entries[std::countr_zero(category)] = std::move(entry);
+            }
+        }
+    }
+
+    g_free(cache_data);
+    g_free(cache_file);
+}
+
+bool DefinitionsIndex::is_indexed(unsigned category) const
+{
+    return this->_entries[std::countr_zero(category)].is_indexed;
+}
+
+unsigned DefinitionsIndex::find(Calculator & calc, std::string_view name, unsigned categories) const
+{
+    unsigned found = 0;
+
+    for (size_t i = 0; i < CATEGORY_COUNT; ++i) {
+        unsigned const category = 1u << i;
+        if (!(categories & category)) {
+            continue;
+        }
+        auto const & entry = this->_entries[i];
+        // A prefix by itself isn't a name, prefixes are only looked at along with a unit below
+        if (!entry.is_indexed || (category != definitions::PREFIXES && contains(entry.names, name))) {
+            found |= category;
+        }
+    }
+
+    // Units with a prefix, e.g. "km"
+    auto const & prefixes = this->_entries[std::countr_zero<unsigned>(definitions::PREFIXES)];
+    for (size_t i = 1; i < name.size(); ++i) {
+        auto const prefix = name.substr(0, i);
+        if (!contains(prefixes.names, prefix) && calc.getPrefix(std::string{prefix}) == nullptr) {
+            continue;
+        }
+        for (unsigned const category : { definitions::UNITS, definitions::CURRENCIES }) {
+            auto const & entry = this->_entries[std::countr_zero(category)];
+            if ((categories & category) && entry.is_indexed && contains(entry.names, name.substr(i))) {
+                found |= category;
+            }
+        }
+    }
+
+    return found;
+}
+
+std::vector<std::string> DefinitionsIndex::collect_names(Calculator & calc)
+{
+    std::vector<std::string> names;
+
+    auto const add_item_names = [&names](auto const & items) {
+        for (auto const * item : items) {
+            for (size_t i = 1; i <= item->countNames(); ++i) {
+                names.push_back(item->getName(i).name);
+            }
+        }
+    };
+    add_item_names(calc.units);
+    add_item_names(calc.functions);
+    add_item_names(calc.variables);
+    for (auto const * prefix : calc.prefixes) {
+        for (auto const * name : { &prefix->longName(false), &prefix->shortName(false), &prefix->unicodeName(false) }) {
+            if (!name->empty()) {
+                names.push_back(*name);
+            }
+        }
+    }
+
+    std::ranges::sort(names);
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+}
+
+void DefinitionsIndex::record(Calculator & calc, unsigned category, std::vector<std::string> const & before)
+{
+    auto const after = collect_names(calc);
+    auto const stamp = definitions::file_stamp(category);
+    auto & entry = this->_entries[std::countr_zero(category)];
+
+    entry.names.clear();
+    std::ranges::set_difference(after, before, std::back_inserter(entry.names));
+    entry.is_indexed = true;
+    entry.mtime = stamp.mtime;
+    entry.size = stamp.size;
+    g_debug("Indexed %zu names of definitions category %u", entry.names.size(), category);
+
+    _write();
+}
+
+void DefinitionsIndex::_write() const
+{
+    gchar * cache_dir = g_build_filename(g_get_user_cache_dir(), "rofi-qalc", NULL);
+    gchar * cache_file = get_cache_filename();
+    GError * error = nullptr;
+    std::string data;
+    uint32_t count = 0;
+
+    data.append(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    put(data, CACHE_VERSION);
+    put(data, QALCULATE_VERSION);
+    put_string(data, definitions::message_locale());
+    size_t const count_offset = data.length();
+    put(data, count);
+
+    for (size_t i = 0; i < CATEGORY_COUNT; ++i) {
+        auto const & entry = this->_entries[i];
+        if (!entry.is_indexed) {
+            continue;
+        }
+        put(data, static_cast<uint32_t>(1u << i));
+        put(data, entry.mtime);
+        put(data, entry.size);
+        put(data, static_cast<uint32_t>(entry.names.size()));
+        for (auto const & name : entry.names) {
+            put_string(data, name);
+        }
+        count += 1;
+    }
+    std::memcpy(data.data() + count_offset, &count, sizeof(count));
+
+    g_mkdir_with_parents(cache_dir, 0755);
+    g_file_set_contents(cache_file, data.data(), static_cast<gssize>(data.length()), &error);
+    if (error != nullptr) {
+        g_warning("Failed to write definition names: %s", error->message);
+        g_error_free(error);
+    }
+
+    g_free(cache_file);
+    g_free(cache_dir);
+}
@@ -0,0 +1,801 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "definitions_snapshot.h"
+#include "binary_io.h"
+#include "definitions.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glib.h>
+#include <libqalculate/qalculate.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+using namespace rq::binary_io;
+using rq::definitions_snapshot::Baseline;
+
+/*
+ * libqalculate's definitions are objects with vtables pointing into each other, so they can't be
+ * mapped back into memory as they are. A snapshot holds what a definitions file sets instead, which
+ * is enough to recreate the definitions through their constructors without the XML parser. Units
+ * refer to other units and prefixes by name, the snapshot keeps the order they were loaded in.
+ * Names and titles are translated while loading, a snapshot is only restored under the same locale.
+ *
+ * Snapshot file layout, see binary_io.h for the encoding:
+ *   char[4] magic, u32 version, u32 category, u32 libqalculate version, string message locale,
+ *   i64 definitions file mtime, i64 definitions file size, u32 record count
+ *   records: u8 kind, then by kind
+ *     DECIMAL_PREFIX, BINARY_PREFIX: i32 exponent, strings long name, short name and unicode name
+ *     BUILTIN_UNIT: string name before loading, item, unit, names
+ *     BASE_UNIT: item, unit, names
+ *     ALIAS_UNIT: item, unit, strings base unit, expression, inverse expression, uncertainty,
+ *                 i32 exponent, mix with base and mix with base minimum, names
+ *     COMPOSITE_UNIT: item, unit, u8 part count, parts: { string unit, i32 exponent, string prefix }, names
+ *     BUILTIN_VARIABLE: string name before loading, item, names
+ *     KNOWN_VARIABLE: item, strings expression, unit and uncertainty, names
+ *   item: strings category, title and description, u8 flags, i32 precision
+ *   unit: strings system and countries, i32 default prefix, max preferred prefix and min preferred prefix
+ *   names: u8 name count, { string name, u16 name flags }
+ */
+static constexpr char SNAPSHOT_MAGIC[4] = { 'R', 'Q', 'D', 'S' };
+static constexpr uint32_t SNAPSHOT_VERSION = 2;
+static constexpr uint32_t QALCULATE_VERSION =
+    QALCULATE_MAJOR_VERSION * 10000 + QALCULATE_MINOR_VERSION * 100 + QALCULATE_MICRO_VERSION;
+
+enum RecordKind : uint8_t
+{
+    /** Prefix for a power of ten, e.g. kilo */
+    DECIMAL_PREFIX,
+    /** Prefix for a power of two, e.g. kibi */
+    BINARY_PREFIX,
+    /** Built-in unit the definitions file gave names and a title, e.g. the euro */
+    BUILTIN_UNIT,
+    /** Unit not defined through others, e.g. the metre */
+    BASE_UNIT,
+    /** Unit defined through another one, e.g. the foot */
+    ALIAS_UNIT,
+    /** Unit made up of others, e.g. the newton metre */
+    COMPOSITE_UNIT,
+    /** Built-in variable the definitions file gave names and a title, e.g. pi */
+    BUILTIN_VARIABLE,
+    /** Variable defined by an expression */
+    KNOWN_VARIABLE,
+};
+
+enum RecordFlags : uint8_t
+{
+    HIDDEN                  = 1 << 0,
+    ACTIVE                  = 1 << 1,
+    APPROXIMATE             = 1 << 2,
+    RELATIVE_UNCERTAINTY    = 1 << 3,
+    USE_WITH_PREFIXES       = 1 << 4,
+};
+
+enum NameFlags : uint16_t
+{
+    ABBREVIATION        = 1 << 0,
+    UNICODE             = 1 << 1,
+    PLURAL              = 1 << 2,
+    REFERENCE           = 1 << 3,
+    AVOID_INPUT         = 1 << 4,
+    SUFFIX              = 1 << 5,
+    CASE_SENSITIVE      = 1 << 6,
+    COMPLETION_ONLY     = 1 << 7,
+};
+
+/** Unit a composite unit is made of */
+struct UnitPart
+{
+    std::string_view unit;
+    int32_t exponent = 1;
+    /** Long name of the prefix, empty if there's none */
+    std::string_view prefix;
+    /** Found while checking the snapshot */
+    Prefix * found_prefix = nullptr;
+};
+
+struct Record
+{
+    RecordKind kind;
+    /** BUILTIN_UNIT, BUILTIN_VARIABLE: name the item had before loading */
+    std::string_view builtin_name;
+    std::string_view category;
+    std::string_view title;
+    std::string_view description;
+    uint8_t flags = 0;
+    int32_t precision = -1;
+    /** Units */
+    std::string_view system;
+    std::string_view countries;
+    int32_t default_prefix = 0;
+    int32_t max_preferred_prefix = 0;
+    int32_t min_preferred_prefix = 0;
+    /** ALIAS_UNIT: name of the unit it's defined through */
+    std::string_view base_unit;
+    /** ALIAS_UNIT, KNOWN_VARIABLE */
+    std::string_view expression;
+    std::string_view uncertainty;
+    /** ALIAS_UNIT */
+    std::string_view inverse_expression;
+    /** ALIAS_UNIT: exponent of the base unit. Prefixes: exponent of ten or two */
+    int32_t exponent = 1;
+    int32_t mix_with_base = 0;
+    int32_t mix_with_base_minimum = 0;
+    /** KNOWN_VARIABLE */
+    std::string_view unit;
+    /** COMPOSITE_UNIT */
+    std::vector<UnitPart> parts;
+    /** Prefixes */
+    std::string_view long_name;
+    std::string_view short_name;
+    std::string_view unicode_name;
+    /** Units, variables */
+    std::vector<ExpressionName> names;
+    /** BUILTIN_UNIT, BUILTIN_VARIABLE: the item, found while checking the snapshot before anything is renamed */
+    ExpressionItem * builtin = nullptr;
+};
+
+struct SnapshotInfo
+{
+    unsigned category;
+    char const * filename;
+};
+
+static constexpr SnapshotInfo SNAPSHOTS[] = {
+    { definitions::PREFIXES, "prefixes.snapshot" },
+    { definitions::UNITS, "units.snapshot" },
+    { definitions::VARIABLES, "variables.snapshot" },
+};
+
+/** @return nullptr if the category has no snapshot */
+static gchar * get_snapshot_filename(unsigned category)
+{
+    for (auto const & info : SNAPSHOTS) {
+        if (info.category == category) {
+            return g_build_filename(g_get_user_cache_dir(), "rofi-qalc", info.filename, NULL);
+        }
+    }
+    return nullptr;
+}
+
+static bool is_unit_record(RecordKind kind)
+{
+    return kind == BUILTIN_UNIT || kind == BASE_UNIT || kind == ALIAS_UNIT || kind == COMPOSITE_UNIT;
+}
+
+static void put_item(std::string & out, ExpressionItem const & item, uint8_t flags)
+{
+    put_string(out, item.category());
+    put_string(out, item.title(false));
+    put_string(out, item.description());
+    put(out, static_cast<uint8_t>(flags
+        | (item.isHidden() ? HIDDEN : 0)
+        | (item.isActive() ? ACTIVE : 0)
+        | (item.isApproximate() ? APPROXIMATE : 0)));
+    put(out, static_cast<int32_t>(item.precision()));
+}
+
+static uint8_t unit_flags(Unit const & unit)
+{
+    return unit.useWithPrefixesByDefault() ? USE_WITH_PREFIXES : 0;
+}
+
+static void put_unit(std::string & out, Unit const & unit)
+{
+    put_string(out, unit.system());
+    put_string(out, unit.countries());
+    put(out, static_cast<int32_t>(unit.defaultPrefix()));
+    put(out, static_cast<int32_t>(unit.maxPreferredPrefix()));
+    put(out, static_cast<int32_t>(unit.minPreferredPrefix()));
+}
+
+/** @return Whether the names fit in a snapshot */
+static bool has_storable_names(ExpressionItem const & item)
+{
+    if (item.countNames() == 0 || item.countNames() > UINT8_MAX) {
+        g_debug("Not writing a definitions snapshot, %s has %lu names", item.name().c_str(), item.countNames());
+        return false;
+    }
+    return true;
+}
+
+static void put_names(std::string & out, ExpressionItem const & item)
+{
+    put(out, static_cast<uint8_t>(item.countNames()));
+    for (size_t i = 1; i <= item.countNames(); ++i) {
+        auto const & ename = item.getName(i);
+        put_string(out, ename.name);
+        put(out, static_cast<uint16_t>(
+            (ename.abbreviation ? ABBREVIATION : 0)
+            | (ename.unicode ? UNICODE : 0)
+            | (ename.plural ? PLURAL : 0)
+            | (ename.reference ? REFERENCE : 0)
+            | (ename.avoid_input ? AVOID_INPUT : 0)
+            | (ename.suffix ? SUFFIX : 0)
+            | (ename.case_sensitive ? CASE_SENSITIVE : 0)
+            | (ename.completion_only ? COMPLETION_ONLY : 0)));
+    }
+}
+
+static bool get_names(std::string_view & in, std::vector<ExpressionName> & names)
+{
+    uint8_t count;
+    if (!get(in, count) || count == 0) {
+        return false;
+    }
+
+    names.resize(count);
+    for (auto & ename : names) {
+        std::string_view name;
+        uint16_t flags;
+        if (!get_string(in, name) || !get(in, flags)) {
+            return false;
+        }
+        ename.name.assign(name);
+        ename.abbreviation = flags & ABBREVIATION;
+        ename.unicode = flags & UNICODE;
+        ename.plural = flags & PLURAL;
+        ename.reference = flags & REFERENCE;
+        ename.avoid_input = flags & AVOID_INPUT;
+        ename.suffix = flags & SUFFIX;
+        ename.case_sensitive = flags & CASE_SENSITIVE;
+        ename.completion_only = flags & COMPLETION_ONLY;
+    }
+
+    return true;
+}
+
+static bool get_parts(std::string_view & in, std::vector<UnitPart> & parts)
+{
+    uint8_t count;
+    if (!get(in, count) || count == 0) {
+        return false;
+    }
+
+    parts.resize(count);
+    for (auto & part : parts) {
+        if (!get_string(in, part.unit) || !get(in, part.exponent) || !get_string(in, part.prefix)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool get_record(std::string_view & in, Record & record)
+{
+    uint8_t kind;
+    if (!get(in, kind) || kind > KNOWN_VARIABLE) {
+        return false;
+    }
+    record.kind = static_cast<RecordKind>(kind);
+
+    if (record.kind == DECIMAL_PREFIX || record.kind == BINARY_PREFIX) {
+        return get(in, record.exponent)
+            && get_string(in, record.long_name)
+            && get_string(in, record.short_name)
+            && get_string(in, record.unicode_name);
+    }
+
+    bool ok = ((record.kind != BUILTIN_UNIT && record.kind != BUILTIN_VARIABLE) || get_string(in, record.builtin_name))
+        && get_string(in, record.category)
+        && get_string(in, record.title)
+        && get_string(in, record.description)
+        && get(in, record.flags)
+        && get(in, record.precision);
+    if (ok && is_unit_record(record.kind)) {
+        ok = get_string(in, record.system)
+            && get_string(in, record.countries)
+            && get(in, record.default_prefix)
+            && get(in, record.max_preferred_prefix)
+            && get(in, record.min_preferred_prefix);
+    }
+    if (ok && record.kind == ALIAS_UNIT) {
+        ok = get_string(in, record.base_unit)
+            && get_string(in, record.expression)
+            && get_string(in, record.inverse_expression)
+            && get_string(in, record.uncertainty)
+            && get(in, record.exponent)
+            && get(in, record.mix_with_base)
+            && get(in, record.mix_with_base_minimum);
+    }
+    if (ok && record.kind == COMPOSITE_UNIT) {
+        ok = get_parts(in, record.parts);
+    }
+    if (ok && record.kind == KNOWN_VARIABLE) {
+        ok = get_string(in, record.expression)
+            && get_string(in, record.unit)
+            && get_string(in, record.uncertainty);
+    }
+
+    return ok && get_names(in, record.names);
+}
+
+template <typename Item>
+static Item * find_builtin(std::vector<Item *> const & items, std::string_view name)
+{
+    for (auto * item : items) {
+        if (item->isBuiltin() && item->name() == name) {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+static void add_unit_names(std::unordered_set<std::string> & names, ExpressionItem const & item)
+{
+    for (size_t i = 1; i <= item.countNames(); ++i) {
+        names.insert(item.getName(i).name);
+    }
+}
+
+/**
+ * Checks that every record can be applied to calc, finding the built-in items and prefixes they
+ * refer to. Unit names are followed as the records change them, so a unit is known to find the
+ * units it refers to once the earlier records have been applied.
+ */
+static bool resolve_records(Calculator & calc, std::vector<Record> & records)
+{
+    std::unordered_set<std::string> unit_names;
+    for (auto const * unit : calc.units) {
+        add_unit_names(unit_names, *unit);
+    }
+
+    for (auto & record : records) {
+        switch (record.kind) {
+            case DECIMAL_PREFIX:
+            case BINARY_PREFIX:
+                // Only written when loading started out without prefixes, see put_prefixes()
+                if (!calc.prefixes.empty()) {
+                    return false;
+                }
+                break;
+            case BUILTIN_UNIT:
+                record.builtin = find_builtin(calc.units, record.builtin_name);
+                if (record.builtin == nullptr) {
+                    return false;
+                }
+                for (size_t i = 1; i <= record.builtin->countNames(); ++i) {
+                    unit_names.erase(record.builtin->getName(i).name);
+                }
+                break;
+            case ALIAS_UNIT:
+                if (!unit_names.contains(std::string{record.base_unit})) {
+                    return false;
+                }
+                break;
+            case COMPOSITE_UNIT:
+                for (auto & part : record.parts) {
+                    if (!unit_names.contains(std::string{part.unit})) {
+                        return false;
+                    }
+                    if (!part.prefix.empty()) {
+                        part.found_prefix = calc.getPrefix(std::string{part.prefix});
+                        if (part.found_prefix == nullptr) {
+                            return false;
+                        }
+                    }
+                }
+                break;
+            case BUILTIN_VARIABLE:
+                record.builtin = find_builtin(calc.variables, record.builtin_name);
+                if (record.builtin == nullptr) {
+                    return false;
+                }
+                break;
+            case BASE_UNIT:
+            case KNOWN_VARIABLE:
+                break;
+        }
+
+        if (is_unit_record(record.kind)) {
+            for (auto const & ename : record.names) {
+                unit_names.insert(ename.name);
+            }
+        }
+    }
+    return true;
+}
+
+/** Sets what the definitions file sets on any item, replacing the names */
+static void apply_item(ExpressionItem & item, Record const & record)
+{
+    item.clearNames();
+    for (auto const & ename : record.names) {
+        item.addName(ename);
+    }
+    item.setCategory(std::string{record.category});
+    item.setTitle(std::string{record.title});
+    item.setDescription(std::string{record.description});
+    item.setHidden(record.flags & HIDDEN);
+    item.setActive(record.flags & ACTIVE);
+    item.setApproximate(record.flags & APPROXIMATE);
+    item.setPrecision(record.precision);
+}
+
+static void apply_unit(Unit & unit, Record const & record)
+{
+    apply_item(unit, record);
+    unit.setSystem(std::string{record.system});
+    unit.setCountries(std::string{record.countries});
+    unit.setUseWithPrefixesByDefault(record.flags & USE_WITH_PREFIXES);
+    unit.setDefaultPrefix(record.default_prefix);
+    unit.setMaxPreferredPrefix(record.max_preferred_prefix);
+    unit.setMinPreferredPrefix(record.min_preferred_prefix);
+}
+
+static void add_unit(Calculator & calc, Unit * unit, Record const & record)
+{
+    apply_unit(*unit, record);
+    calc.addUnit(unit);
+    unit->setChanged(false);
+}
+
+static void apply_record(Calculator & calc, Record const & record)
+{
+    std::string const category{record.category};
+    std::string const title{record.title};
+    bool const active = record.flags & ACTIVE;
+    // The constructors only take the first name's text, apply_item() sets all of them
+    std::string const name = record.names.empty() ? std::string{} : record.names.front().name;
+
+    switch (record.kind) {
+        case DECIMAL_PREFIX:
+            calc.addPrefix(new DecimalPrefix(record.exponent, std::string{record.long_name},
+                std::string{record.short_name}, std::string{record.unicode_name}));
+            break;
+        case BINARY_PREFIX:
+            calc.addPrefix(new BinaryPrefix(record.exponent, std::string{record.long_name},
+                std::string{record.short_name}, std::string{record.unicode_name}));
+            break;
+        case BUILTIN_UNIT: {
+            auto & unit = static_cast<Unit &>(*record.builtin);
+            apply_unit(unit, record);
+            unit.setChanged(false);
+            break;
+        }
+        case BASE_UNIT:
+            add_unit(calc, new Unit(category, name, "", "", title, false, false, active), record);
+            break;
+        case ALIAS_UNIT: {
+            auto * alias = new AliasUnit(category, name, "", "", title, calc.getUnit(std::string{record.base_unit}),
+                std::string{record.expression}, record.exponent, std::string{record.inverse_expression},
+                false, false, active);
+            alias->setMixWithBase(record.mix_with_base);
+            alias->setMixWithBaseMinimum(record.mix_with_base_minimum);
+            if (!record.uncertainty.empty()) {
+                alias->setUncertainty(std::string{record.uncertainty}, record.flags & RELATIVE_UNCERTAINTY);
+            }
+            add_unit(calc, alias, record);
+            break;
+        }
+        case COMPOSITE_UNIT: {
+            auto * composite = new CompositeUnit(category, name, title, "", false, false, active);
+            for (auto const & part : record.parts) {
+                composite->add(calc.getUnit(std::string{part.unit}), part.exponent, part.found_prefix);
+            }
+            add_unit(calc, composite, record);
+            break;
+        }
+        case BUILTIN_VARIABLE:
+            // Only the names and the description are the definitions file's, the definition stays
+            apply_item(*record.builtin, record);
+            record.builtin->setChanged(false);
+            break;
+        case KNOWN_VARIABLE: {
+            auto * variable = new KnownVariable(category, name, std::string{record.expression}, title,
+                false, false, active);
+            apply_item(*variable, record);
+            if (!record.uncertainty.empty()) {
+                variable->setUncertainty(std::string{record.uncertainty}, record.flags & RELATIVE_UNCERTAINTY);
+            }
+            if (!record.unit.empty()) {
+                variable->setUnit(std::string{record.unit});
+            }
+            calc.addVariable(variable);
+            variable->setChanged(false);
+            break;
+        }
+    }
+}
+
+/** Prefixes are all new, there's nothing to refer to */
+static bool put_prefixes(Calculator & calc, Baseline const & baseline, std::string & out, uint32_t & count)
+{
+    // Loading may have changed prefixes that were there already, which can't be told from here
+    if (baseline.prefix_count != 0) {
+        g_debug("Not writing a prefixes snapshot, there were prefixes before loading");
+        return false;
+    }
+
+    for (auto const * prefix : calc.prefixes) {
+        switch (prefix->type()) {
+            case PREFIX_DECIMAL:
+                put(out, DECIMAL_PREFIX);
+                put(out, static_cast<int32_t>(static_cast<DecimalPrefix const *>(prefix)->exponent()));
+                break;
+            case PREFIX_BINARY:
+                put(out, BINARY_PREFIX);
+                put(out, static_cast<int32_t>(static_cast<BinaryPrefix const *>(prefix)->exponent()));
+                break;
+            default:
+                g_debug("Not writing a prefixes snapshot, %s can't be restored from it", prefix->longName().c_str());
+                return false;
+        }
+        put_string(out, prefix->longName(false));
+        put_string(out, prefix->shortName(false));
+        put_string(out, prefix->unicodeName(false));
+        count += 1;
+    }
+    return true;
+}
+
+static bool put_units(Calculator & calc, Baseline const & baseline, std::string & out, uint32_t & count)
+{
+    std::unordered_map<Unit const *, size_t> positions;
+    for (size_t i = 0; i < calc.units.size(); ++i) {
+        positions.emplace(calc.units[i], i);
+    }
+
+    for (size_t i = 0; i < calc.units.size(); ++i) {
+        auto * unit = calc.units[i];
+        // Units refer to others by name, a unit has to be restored before the units referring to it
+        auto const is_referable = [&calc, &positions, i](Unit * other) {
+            auto const it = positions.find(other);
+            return it != positions.end() && it->second < i && calc.getUnit(other->name()) == other;
+        };
+        bool storable = has_storable_names(*unit);
+
+        if (i < baseline.unit_names.size()) {
+            // Built-in units exist before loading, the definitions file only names and describes them
+            if (!unit->isBuiltin()) {
+                continue;
+            }
+            put(out, BUILTIN_UNIT);
+            put_string(out, baseline.unit_names[i]);
+            put_item(out, *unit, unit_flags(*unit));
+            put_unit(out, *unit);
+        } else if (unit->isBuiltin() || unit->isLocal()) {
+            storable = false;
+        } else if (unit->subtype() == SUBTYPE_BASE_UNIT) {
+            put(out, BASE_UNIT);
+            put_item(out, *unit, unit_flags(*unit));
+            put_unit(out, *unit);
+        } else if (unit->subtype() == SUBTYPE_ALIAS_UNIT) {
+            auto const * alias = static_cast<AliasUnit const *>(unit);
+            auto * base = alias->firstBaseUnit();
+            bool is_relative = false;
+            auto const uncertainty = alias->uncertainty(&is_relative);
+
+            storable = storable && is_referable(base);
+            put(out, ALIAS_UNIT);
+            put_item(out, *alias, unit_flags(*alias) | (is_relative ? RELATIVE_UNCERTAINTY : 0));
+            put_unit(out, *alias);
+            put_string(out, base->name());
+            put_string(out, alias->expression());
+            put_string(out, alias->inverseExpression());
+            put_string(out, uncertainty);
+            put(out, static_cast<int32_t>(alias->firstBaseExponent()));
+            put(out, static_cast<int32_t>(alias->mixWithBase()));
+            put(out, static_cast<int32_t>(alias->mixWithBaseMinimum()));
+        } else if (unit->subtype() == SUBTYPE_COMPOSITE_UNIT) {
+            auto const * composite = static_cast<CompositeUnit const *>(unit);
+
+            storable = storable && composite->countUnits() > 0 && composite->countUnits() <= UINT8_MAX;
+            put(out, COMPOSITE_UNIT);
+            put_item(out, *composite, unit_flags(*composite));
+            put_unit(out, *composite);
+            put(out, static_cast<uint8_t>(composite->countUnits()));
+            // Parts are counted from 1, like names
+            for (size_t j = 1; storable && j <= composite->countUnits(); ++j) {
+                int exponent = 1;
+                Prefix * prefix = nullptr;
+                auto * part = composite->get(j, &exponent, &prefix);
+
+                storable = part != nullptr && is_referable(part)
+                    && (prefix == nullptr || calc.getPrefix(prefix->longName()) == prefix);
+                if (storable) {
+                    put_string(out, part->name());
+                    put(out, static_cast<int32_t>(exponent));
+                    put_string(out, prefix != nullptr ? prefix->longName() : std::string{});
+                }
+            }
+        } else {
+            storable = false;
+        }
+
+        if (!storable) {
+            g_debug("Not writing a units snapshot, %s can't be restored from it", unit->name().c_str());
+            return false;
+        }
+        put_names(out, *unit);
+        count += 1;
+    }
+    return true;
+}
+
+static bool put_variables(Calculator & calc, Baseline const & baseline, std::string & out, uint32_t & count)
+{
+    for (size_t i = 0; i < calc.variables.size(); ++i) {
+        auto const * variable = calc.variables[i];
+
+        if (!has_storable_names(*variable)) {
+            return false;
+        }
+        if (i < baseline.variable_names.size()) {
+            // Built-in variables exist before loading, the definitions file only names and describes them
+            if (!variable->isBuiltin()) {
+                continue;
+            }
+            put(out, BUILTIN_VARIABLE);
+            put_string(out, baseline.variable_names[i]);
+            put_item(out, *variable, 0);
+        } else {
+            auto const * known = dynamic_cast<KnownVariable const *>(variable);
+            if (known == nullptr || known->isBuiltin() || known->isLocal() || !known->isExpression()) {
+                g_debug("Not writing a variables snapshot, %s can't be restored from it",
+                    variable->name().c_str());
+                return false;
+            }
+
+            bool is_relative = false;
+            auto const & uncertainty = known->uncertainty(&is_relative);
+            put(out, KNOWN_VARIABLE);
+            put_item(out, *known, is_relative ? RELATIVE_UNCERTAINTY : 0);
+            put_string(out, known->expression());
+            put_string(out, known->unit());
+            put_string(out, uncertainty);
+        }
+        put_names(out, *variable);
+        count += 1;
+    }
+    return true;
+}
+
+bool definitions_snapshot::is_supported(unsigned category)
+{
+    for (auto const & info : SNAPSHOTS) {
+        if (info.category == category) {
+            return true;
+        }
+    }
+    return false;
+}
+
+definitions_snapshot::Baseline definitions_snapshot::take_baseline(Calculator const & calc)
+{
+    Baseline baseline;
+
+    baseline.prefix_count = calc.prefixes.size();
+    baseline.unit_names.reserve(calc.units.size());
+    for (auto const * unit : calc.units) {
+        baseline.unit_names.push_back(unit->name());
+    }
+    baseline.variable_names.reserve(calc.variables.size());
+    for (auto const * variable : calc.variables) {
+        baseline.variable_names.push_back(variable->name());
+    }
+
+    return baseline;
+}
+
+bool definitions_snapshot::restore(Calculator & calc, unsigned category)
+{
+    auto const stamp = definitions::file_stamp(category);
+    gchar * snapshot_file = get_snapshot_filename(category);
+    if (snapshot_file == nullptr || stamp.mtime < 0) {
+        g_free(snapshot_file);
+        return false;
+    }
+
+    gchar * snapshot_data = nullptr;
+    gsize snapshot_size = 0;
+    std::vector<Record> records;
+    bool ok = false;
+
+    if (g_file_get_contents(snapshot_file, &snapshot_data, &snapshot_size, nullptr)) {
+        std::string_view in{snapshot_data, snapshot_size};
+        uint32_t version;
+        uint32_t snapshot_category;
+        uint32_t qalculate_version;
+        std::string_view locale;
+        definitions::FileStamp snapshot_stamp;
+        uint32_t count;
+
+        ok = in.starts_with(std::string_view{SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)});
+        if (ok) {
+            in.remove_prefix(sizeof(SNAPSHOT_MAGIC));
+            ok = get(in, version) && version == SNAPSHOT_VERSION
+                && get(in, snapshot_category) && snapshot_category == category
+                && get(in, qalculate_version) && qalculate_version == QALCULATE_VERSION
+                && get_string(in, locale) && locale == definitions::message_locale()
+                && get(in, snapshot_stamp.mtime) && get(in, snapshot_stamp.size) && snapshot_stamp == stamp
+                && get(in, count) && count <= in.length();
+        }
+
+        // Everything is read and checked first, so a bad snapshot leaves calc as it was
+        records.resize(ok ? count : 0);
+        for (auto & record : records) {
+            ok = ok && get_record(in, record);
+        }
+        ok = ok && resolve_records(calc, records);
+    }
+
+    if (ok) {
+        for (auto const & record : records) {
+            apply_record(calc, record);
+        }
+        g_debug("Restored %lu definitions from %s", records.size(), snapshot_file);
+    }
+
+    g_free(snapshot_data);
+    g_free(snapshot_file);
+    return ok;
+}
+
+void definitions_snapshot::write(Calculator & calc, unsigned category, Baseline const & baseline)
+{
+    auto const stamp = definitions::file_stamp(category);
+    if (!is_supported(category) || stamp.mtime < 0) {
+        return;
+    }
+
+    std::string data;
+    uint32_t count = 0;
+
+    data.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put(data, SNAPSHOT_VERSION);
+    put(data, static_cast<uint32_t>(category));
+    put(data, QALCULATE_VERSION);
+    put_string(data, definitions::message_locale());
+    put(data, stamp.mtime);
+    put(data, stamp.size);
+    size_t const count_offset = data.length();
+    put(data, count);
+
+    bool const ok = category == definitions::PREFIXES ? put_prefixes(calc, baseline, data, count)
+        : category == definitions::UNITS ? put_units(calc, baseline, data, count)
+        : put_variables(calc, baseline, data, count);
+    if (!ok) {
+        return;
+    }
+    std::memcpy(data.data() + count_offset, &count, sizeof(count));
+
+    gchar * cache_dir = g_build_filename(g_get_user_cache_dir(), "rofi-qalc", NULL);
+    gchar * snapshot_file = get_snapshot_filename(category);
+    GError * error = nullptr;
+
+    g_mkdir_with_parents(cache_dir, 0755);
+    g_file_set_contents(snapshot_file, data.data(), static_cast<gssize>(data.length()), &error);
+    if (error != nullptr) {
+        g_warning("Failed to write definitions snapshot: %s", error->message);
+        g_error_free(error);
+    } else {
+        g_debug("Wrote %u definitions to %s, %lu b", count, snapshot_file, data.length());
+    }
+
+    g_free(snapshot_file);
+    g_free(cache_dir);
+}
@@ -0,0 +1,225 @@
+/*
+* rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "exchange_rates.h"
+#include "binary_io.h"
+#include "definitions.h"
+#include "parsing.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libqalculate/qalculate.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+using namespace rq::binary_io;
+
+/*
+ * Cache file layout, see binary_io.h for the encoding:
+ *   char[4] magic, u32 version, i64 source stamp, u32 entry count
+ *   entries: { u16 length, bytes } x 5 -- name, base unit name, category, title, expression
+ */
+static constexpr char CACHE_MAGIC[4] = { 'R', 'Q', 'X', 'R' };
+static constexpr uint32_t CACHE_VERSION = 1;
+static constexpr size_t CACHE_FIELDS = 5;
+/** Upper bound for libqalculate's rate file indices, it returns "" past the last one */
+static constexpr int MAX_RATE_FILES = 16;
+
+static gchar * get_cache_dir()
+{
+    return g_build_filename(g_get_user_cache_dir(), "rofi-qalc", NULL);
+}
+
+static gchar * get_cache_filename(gchar const * cache_dir)
+{
+    return g_build_filename(cache_dir, "exchange_rates.cache", NULL);
+}
+
+int64_t rq::exchange_rates::source_stamp(Calculator & calc)
+{
+    int64_t stamp = 0;
+
+    for (int i = 1; i <= MAX_RATE_FILES; ++i) {
+        auto const filename = calc.getExchangeRatesFileName(i);
+        if (filename.empty()) {
+            break;
+        }
+
+        GStatBuf st;
+        int64_t const mtime = g_stat(filename.c_str(), &st) == 0 ? st.st_mtime : -1;
+        stamp = stamp * 31 + mtime;
+    }
+
+    return stamp;
+}
+
+static void write_cache(Calculator & calc, int64_t const stamp)
+{
+    gchar * cache_dir = get_cache_dir();
+    gchar * cache_file = get_cache_filename(cache_dir);
+    GError * error = nullptr;
+    std::string data;
+    uint32_t count = 0;
+
+    data.append(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    put(data, CACHE_VERSION);
+    put(data, stamp);
+    put(data, count);
+
+    for (auto * unit : calc.units) {
+        if (!unit->isCurrency() || unit->subtype() != SUBTYPE_ALIAS_UNIT) {
+            continue;
+        }
+        auto const * alias = static_cast<AliasUnit const *>(unit);
+
+        put_string(data, alias->name());
+        put_string(data, alias->firstBaseUnit()->name());
+        put_string(data, alias->category());
+        put_string(data, alias->title(false));
+        put_string(data, alias->expression());
+        count += 1;
+    }
+    std::memcpy(data.data() + sizeof(CACHE_MAGIC) + sizeof(CACHE_VERSION) + sizeof(stamp),
+        &count, sizeof(count));
+
+    g_mkdir_with_parents(cache_dir, 0755);
+    g_file_set_contents(cache_file, data.data(), static_cast<gssize>(data.length()), &error);
+    if (error != nullptr) {
+        g_warning("Failed to write exchange rate cache: %s", error->message);
+        g_error_free(error);
+    } else {
+        g_debug("Wrote %u exchange rates to %s, %lu b", count, cache_file, data.length());
+    }
+
+    g_free(cache_file);
+    g_free(cache_dir);
+}
+
+static bool apply_cache_entry(Calculator & calc, std::string_view const (&fields)[CACHE_FIELDS])
+{
+    auto const &[name, base_name, category, title, expression] = fields;
+
+    auto * unit = calc.getUnit(std::string{name});
+    if (unit != nullptr) {
+        auto * alias = dynamic_cast<AliasUnit *>(unit);
+        if (alias == nullptr) {
+            return false;
+        }
+        alias->setExpression(std::string{expression});
+        return true;
+    }
+
+    // Currency that only exists in the downloaded rate files, create it like libqalculate does
+    auto * base = calc.getUnit(std::string{base_name});
+    if (base == nullptr) {
+        return false;
+    }
+    calc.addUnit(new AliasUnit(std::string{category}, std::string{name}, "", "",
+        std::string{title}, base, std::string{expression}, 1, "", false, true));
+    return true;
+}
+
+static bool read_cache(Calculator & calc, int64_t const stamp)
+{
+    gchar * cache_dir = get_cache_dir();
+    gchar * cache_file = get_cache_filename(cache_dir);
+    gchar * cache_data = nullptr;
+    gsize cache_size = 0;
+    bool ok = false;
+
+    if (g_file_get_contents(cache_file, &cache_data, &cache_size, nullptr)) {
+        std::string_view in{cache_data, cache_size};
+        uint32_t version;
+        int64_t cached_stamp;
+        uint32_t count;
+
+        ok = in.starts_with(std::string_view{CACHE_MAGIC, sizeof(CACHE_MAGIC)});
+        if (ok) {
+            in.remove_prefix(sizeof(CACHE_MAGIC));
+            ok = get(in, version) && version == CACHE_VERSION
+                && get(in, cached_stamp) && cached_stamp == stamp
+                && get(in, count);
+        }
+
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            std::string_view fields[CACHE_FIELDS];
+            for (auto & field : fields) {
+                ok = ok && get_string(in, field);
+            }
+            ok = ok && apply_cache_entry(calc, fields);
+        }
+    }
+
+    g_free(cache_data);
+    g_free(cache_file);
+    g_free(cache_dir);
+    return ok;
+}
+
+/** Whether the name has the shape of an ISO 4217 currency code, e.g. "USD" */
+static bool is_currency_code(std::string_view const & name)
+{
+    return name.length() == 3 && std::ranges::all_of(name, [](char c) {
+        return c >= 'A' && c <= 'Z';
+    });
+}
+
+bool exchange_rates::expression_needs_rates(Calculator & calc, std::string_view const & expression)
+{
+    bool needs_rates = false;
+
+    parsing::for_each_identifier(expression, [&](std::string_view const & identifier) {
+        std::string const name{identifier};
+
+        if (auto const * unit = calc.getActiveUnit(name); unit != nullptr) {
+            needs_rates = unit->isCurrency();
+        } else {
+            // Half-typed names and variables aren't currencies, the rate files only add currency codes
+            needs_rates = is_currency_code(name) && !definitions::is_known_name(calc, name);
+        }
+        return !needs_rates;
+    });
+
+    return needs_rates;
+}
+
+bool exchange_rates::load(Calculator & calc)
+{
+    gint64 const start_us = g_get_monotonic_time();
+    int64_t const stamp = source_stamp(calc);
+
+    // A partially applied cache is fine here, loadExchangeRates() overwrites every rate
+    if (read_cache(calc, stamp)) {
+        g_debug("Loaded exchange rates from cache in %ld us", g_get_monotonic_time() - start_us);
+        return true;
+    }
+
+    if (!calc.loadExchangeRates()) {
+        return false;
+    }
+    g_debug("Loaded exchange rates from rate files in %ld us", g_get_monotonic_time() - start_us);
+
+    write_cache(calc, stamp);
+    return true;
+}
@@ -0,0 +1,165 @@
+/*
+* rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "expression_cache.h"
+#include "alloc_counter.h"
+
+#include <libqalculate/qalculate.h>
+
+using namespace rq;
+
+static constexpr bool starts_with(char const * const haystack, std::string const & needle)
+{
+    bool gobble_whitespace = true;
+    char const * ptr = haystack;
+    std::string::size_type pos = 0;
+    while (*ptr != 0) {
+        if (std::isspace(*ptr) && gobble_whitespace) {
+            ptr += 1;
+            continue;
+        }
+        gobble_whitespace = false;
+
+        if (std::tolower(*ptr) != std::tolower(needle.c_str()[pos])) {
+            return false;
+        }
+
+        pos += 1;
+        ptr += 1;
+
+        if (pos == needle.length()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Whether the structure is made up of units only, e.g. "mi" or "km/h" */
+static bool is_unit_expression(MathStructure const & mstruct)
+{
+    switch (mstruct.type()) {
+        case STRUCT_UNIT:
+            return true;
+        case STRUCT_POWER:
+            return is_unit_expression(mstruct[0]) && mstruct[1].isNumber();
+        case STRUCT_MULTIPLICATION:
+        case STRUCT_DIVISION:
+        case STRUCT_INVERSE:
+            for (size_t i = 0; i < mstruct.size(); ++i) {
+                if (!mstruct[i].isNumber() && !is_unit_expression(mstruct[i])) {
+                    return false;
+                }
+            }
+            return mstruct.size() > 0;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Fills in a cache entry, which may be a recycled one.
+ * @param spare Structure of a recycled entry, used instead of allocating a new one
+ */
+static void parse_expression(Calculator & calc, std::string const & expression,
+                             EvaluationOptions const & eo, ParsedExpression & entry,
+                             std::unique_ptr<MathStructure> & spare)
+{
+    alloc_counter::ExternalScope const libqalculate;
+    std::string & base = entry.base;
+
+    entry.conversion.clear();
+    base.clear();
+    entry.kind = QueryKind::PLAIN;
+    entry.is_unit_conversion = false;
+    entry.unlocalized = calc.unlocalizeExpression(expression, eo.parse_options);
+
+    if (starts_with(entry.unlocalized.c_str(), "plot(")) {
+        entry.kind = QueryKind::PLOT;
+    } else if (expression_contains_save_function(entry.unlocalized, eo.parse_options, false)) {
+        // Assignments have side effects, those are always evaluated from text
+        entry.kind = QueryKind::ASSIGNMENT;
+        return;
+    }
+
+    base.assign(entry.unlocalized);
+    if (entry.kind == QueryKind::PLAIN && calc.separateToExpression(base, entry.conversion, eo)) {
+        entry.kind = QueryKind::CONVERSION;
+    }
+    // "where" clauses are handled by the text parser only
+    if (base.find("where") != std::string::npos) {
+        return;
+    }
+
+    entry.parsed = spare != nullptr ? std::move(spare) : std::make_unique<MathStructure>();
+    calc.parse(entry.parsed.get(), base, eo.parse_options);
+
+    if (entry.kind == QueryKind::CONVERSION) {
+        entry.is_unit_conversion = is_unit_expression(calc.parse(entry.conversion, eo.parse_options));
+    }
+}
+
+ExpressionCache::ExpressionCache(size_t capacity)
+    : _capacity(capacity)
+{
+}
+
+ExpressionCache::~ExpressionCache() = default;
+
+ParsedExpression const & ExpressionCache::get(Calculator & calc, std::string const & expression,
+                                              EvaluationOptions const & eo, unsigned generation)
+{
+    if (generation != this->_generation) {
+        clear();
+        this->_generation = generation;
+    }
+
+    if (auto const it = this->_index.find(expression); it != this->_index.end()) {
+        this->_entries.splice(this->_entries.begin(), this->_entries, it->second);
+        return it->second->second;
+    }
+
+    if (this->_entries.size() >= this->_capacity) {
+        // Recycles the least recently used entry, reusing its nodes and string buffers
+        auto node = this->_index.extract(this->_entries.back().first);
+        this->_entries.splice(this->_entries.begin(), this->_entries, std::prev(this->_entries.end()));
+
+        auto & [key, entry] = this->_entries.front();
+        key.assign(expression);
+        if (entry.parsed != nullptr) {
+            this->_spare_structure = std::move(entry.parsed);
+        }
+        node.key() = key;
+        node.mapped() = this->_entries.begin();
+        this->_index.insert(std::move(node));
+    } else {
+        auto & [key, _] = this->_entries.emplace_front(expression, ParsedExpression{});
+        this->_index.emplace(key, this->_entries.begin());
+    }
+
+    auto & [key, entry] = this->_entries.front();
+    parse_expression(calc, key, eo, entry, this->_spare_structure);
+
+    return entry;
+}
+
+void ExpressionCache::clear()
+{
+    this->_index.clear();
+    this->_entries.clear();
+}
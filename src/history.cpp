@@ -0,0 +1,156 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "history.h"
+#include "memory_report.h"
+
+using namespace rq;
+
+size_t History::KeyHash::operator()(Key const & key) const
+{
+    constexpr std::hash<std::string_view> hasher;
+    size_t const seed = hasher(key.expression);
+    return seed ^ (hasher(key.result) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+History::History(bool deduplicate)
+    : _deduplicate(deduplicate)
+{
+}
+
+HistoryEntry const & History::operator[](size_t index) const
+{
+    if (!this->_positions_valid) {
+        _update_positions();
+    }
+    return *this->_positions[index];
+}
+
+HistoryEntry const * History::find(unsigned id) const
+{
+    auto const it = this->_ids.find(id);
+    return it != this->_ids.end() ? &*it->second : nullptr;
+}
+
+HistoryEntry const & History::append(HistoryEntry entry)
+{
+    this->_positions_valid = false;
+
+    if (this->_deduplicate) {
+        if (auto const it = this->_index.find({entry.expression, entry.result}); it != this->_index.end()) {
+            auto const existing = it->second;
+            // Stays in the history file if either of them was meant to
+            existing->persistent = existing->persistent || entry.persistent;
+            this->_entries.splice(this->_entries.end(), this->_entries, existing);
+            return *existing;
+        }
+    }
+
+    entry.id = ++this->_last_id;
+    auto & added = this->_entries.emplace_back(std::move(entry));
+    auto const it = std::prev(this->_entries.end());
+    this->_ids.emplace(added.id, it);
+    if (this->_deduplicate) {
+        this->_index.emplace(Key{added.expression, added.result}, it);
+    }
+    return added;
+}
+
+bool History::set_result(unsigned id, std::string result)
+{
+    auto const found = this->_ids.find(id);
+    if (found == this->_ids.end()) {
+        return false;
+    }
+    auto const it = found->second;
+
+    if (this->_deduplicate) {
+        _unindex(it);
+        it->result = std::move(result);
+        // An entry that turned into a duplicate of another stays, only the other one is indexed
+        this->_index.emplace(Key{it->expression, it->result}, it);
+    } else {
+        it->result = std::move(result);
+    }
+    return true;
+}
+
+void History::erase(size_t index)
+{
+    if (!this->_positions_valid) {
+        _update_positions();
+    }
+    _erase(this->_positions[index]);
+}
+
+void History::pop_front()
+{
+    _erase(this->_entries.begin());
+}
+
+void History::clear()
+{
+    this->_index.clear();
+    this->_ids.clear();
+    this->_entries.clear();
+    this->_positions_valid = false;
+}
+
+void History::_unindex(Entries::const_iterator it)
+{
+    // The key may belong to an identical entry, see set_result()
+    if (auto const found = this->_index.find({it->expression, it->result});
+            found != this->_index.end() && found->second == it) {
+        this->_index.erase(found);
+    }
+}
+
+void History::_erase(Entries::const_iterator it)
+{
+    if (this->_deduplicate) {
+        _unindex(it);
+    }
+    this->_ids.erase(it->id);
+    this->_entries.erase(it);
+    this->_positions_valid = false;
+}
+
+void History::_update_positions() const
+{
+    this->_positions.clear();
+    for (auto it = this->_entries.cbegin(); it != this->_entries.cend(); ++it) {
+        this->_positions.push_back(it);
+    }
+    this->_positions_valid = true;
+}
+
+size_t History::memory_usage() const
+{
+    // A list node is the entry plus two pointers, an index node the key and iterator plus the next
+    // pointer and the cached hash
+    size_t bytes = this->_entries.size() * (sizeof(HistoryEntry) + 2 * sizeof(void *));
+    for (auto const & entry : this->_entries) {
+        bytes += MemoryReport::string_bytes(entry.expression) + MemoryReport::string_bytes(entry.result);
+    }
+    bytes += this->_index.size() * (sizeof(decltype(this->_index)::value_type) + 2 * sizeof(void *));
+    bytes += this->_index.bucket_count() * sizeof(void *);
+    bytes += this->_ids.size() * (sizeof(decltype(this->_ids)::value_type) + 2 * sizeof(void *));
+    bytes += this->_ids.bucket_count() * sizeof(void *);
+    bytes += this->_positions.capacity() * sizeof(Entries::const_iterator);
+    return bytes;
+}
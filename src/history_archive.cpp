@@ -0,0 +1,300 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "history_archive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+/*
+ * Index files start with INDEX_MAGIC followed by the Block records, in native byte order as the
+ * archive never leaves the machine. A block holds its entries oldest first, each as a flag byte
+ * ('A' for assignments, 'R' otherwise), the expression and the result, both NUL-terminated.
+ */
+
+static constexpr char INDEX_MAGIC[8] = {'R', 'Q', 'H', 'I', 'D', 'X', '1', '\n'};
+
+/** Bit of a trigram in Block::trigrams */
+static unsigned trigram_bit(unsigned char a, unsigned char b, unsigned char c)
+{
+    uint32_t const trigram = static_cast<uint32_t>(a) << 16 | static_cast<uint32_t>(b) << 8 | c;
+    return (trigram * 2654435761u) >> 24;
+}
+
+static void add_trigrams(std::string_view text, uint8_t (&trigrams)[32])
+{
+    for (size_t i = 0; i + 2 < text.length(); ++i) {
+        unsigned const bit = trigram_bit(text[i], text[i + 1], text[i + 2]);
+        trigrams[bit / 8] |= 1u << (bit % 8);
+    }
+}
+
+/** Whether every trigram in wanted is in trigrams, a needle shorter than 3 has none */
+static bool has_trigrams(uint8_t const (&trigrams)[32], uint8_t const (&wanted)[32])
+{
+    for (size_t i = 0; i < std::size(wanted); ++i) {
+        if ((trigrams[i] & wanted[i]) != wanted[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HistoryArchive::HistoryArchive(std::string directory)
+    : _directory(std::move(directory))
+{
+    static_assert(sizeof(Block) == 56, "Block is stored as is");
+}
+
+bool HistoryArchive::append(std::vector<HistoryEntry> const & entries)
+{
+    if (entries.empty()) {
+        return true;
+    }
+    _load();
+
+    Block block{};
+    this->_raw.clear();
+    for (auto const & entry : entries) {
+        this->_raw.push_back(entry.is_assignment ? 'A' : 'R');
+        this->_raw.append(entry.expression).push_back('\0');
+        this->_raw.append(entry.result).push_back('\0');
+        add_trigrams(entry.expression, block.trigrams);
+        add_trigrams(entry.result, block.trigrams);
+    }
+
+    uLongf compressed_size = compressBound(this->_raw.length());
+    this->_compressed.resize(compressed_size);
+    int const rc = compress2(reinterpret_cast<Bytef *>(this->_compressed.data()), &compressed_size,
+        reinterpret_cast<Bytef const *>(this->_raw.data()), this->_raw.length(), Z_BEST_COMPRESSION);
+    if (rc != Z_OK) {
+        g_warning("Failed to compress %zu history entries: %d", entries.size(), rc);
+        return false;
+    }
+
+    if (this->_segments.empty() || this->_segments.back().size >= SEGMENT_SIZE) {
+        unsigned const number = this->_segments.empty() ? 0 : this->_segments.back().number + 1;
+        this->_segments.push_back({number, 0, {}});
+    }
+    Segment & segment = this->_segments.back();
+
+    g_mkdir_with_parents(this->_directory.c_str(), 0755);
+    std::string const segment_path = _path(segment.number, "seg");
+    std::FILE * segment_file = g_fopen(segment_path.c_str(), "ab");
+    if (segment_file == nullptr) {
+        g_warning("Failed to open history archive segment %s", segment_path.c_str());
+        return false;
+    }
+    // Past anything a torn write left behind, that's never referenced by the index
+    std::fseek(segment_file, 0, SEEK_END);
+    block.offset = std::ftell(segment_file);
+    block.compressed_size = compressed_size;
+    block.raw_size = this->_raw.length();
+    block.entry_count = entries.size();
+    bool const written = std::fwrite(this->_compressed.data(), 1, compressed_size, segment_file) == compressed_size;
+    if (std::fclose(segment_file) != 0 || !written) {
+        g_warning("Failed to write history archive segment %s", segment_path.c_str());
+        return false;
+    }
+
+    // Indexed only once the block is complete
+    std::string const index_path = _path(segment.number, "idx");
+    std::FILE * index_file = g_fopen(index_path.c_str(), "ab");
+    if (index_file == nullptr) {
+        g_warning("Failed to open history archive index %s", index_path.c_str());
+        return false;
+    }
+    std::fseek(index_file, 0, SEEK_END);
+    bool indexed = std::ftell(index_file) > 0
+        || std::fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, index_file) == 1;
+    indexed = indexed && std::fwrite(&block, sizeof(block), 1, index_file) == 1;
+    if (std::fclose(index_file) != 0 || !indexed) {
+        g_warning("Failed to write history archive index %s", index_path.c_str());
+        return false;
+    }
+
+    segment.size = block.offset + block.compressed_size;
+    segment.blocks.push_back(block);
+    g_debug("Archived %zu history entries in %u b", entries.size(), block.compressed_size);
+    return true;
+}
+
+void HistoryArchive::search(std::string_view needle, size_t limit, std::vector<HistoryEntry> & matches)
+{
+    _load();
+
+    uint8_t wanted[32] = {};
+    add_trigrams(needle, wanted);
+
+    for (auto segment = this->_segments.rbegin(); segment != this->_segments.rend(); ++segment) {
+        std::string const segment_path = _path(segment->number, "seg");
+        std::FILE * segment_file = nullptr;
+
+        for (auto block = segment->blocks.rbegin(); block != segment->blocks.rend(); ++block) {
+            if (matches.size() >= limit) {
+                break;
+            }
+            if (!has_trigrams(block->trigrams, wanted)) {
+                continue;
+            }
+
+            if (segment_file == nullptr) {
+                segment_file = g_fopen(segment_path.c_str(), "rb");
+                if (segment_file == nullptr) {
+                    g_warning("Failed to open history archive segment %s", segment_path.c_str());
+                    break;
+                }
+            }
+            if (!_read_block(segment_file, *block)) {
+                g_warning("Skipping damaged block at %lu in %s",
+                    static_cast<unsigned long>(block->offset), segment_path.c_str());
+                continue;
+            }
+
+            size_t const first_match = matches.size();
+            std::string_view remaining{this->_raw};
+            for (uint32_t i = 0; i < block->entry_count && remaining.length() > 1; ++i) {
+                bool const is_assignment = remaining.front() == 'A';
+                remaining.remove_prefix(1);
+                auto const expression = remaining.substr(0, remaining.find('\0'));
+                remaining.remove_prefix(std::min(remaining.length(), expression.length() + 1));
+                auto const result = remaining.substr(0, remaining.find('\0'));
+                remaining.remove_prefix(std::min(remaining.length(), result.length() + 1));
+
+                if (expression.find(needle) != std::string_view::npos
+                        || result.find(needle) != std::string_view::npos) {
+                    matches.push_back({std::string{expression}, std::string{result}, true, is_assignment});
+                }
+            }
+            // Newest first, which also keeps the newest ones when there are too many
+            std::reverse(matches.begin() + first_match, matches.end());
+            if (matches.size() > limit) {
+                matches.resize(limit);
+            }
+        }
+
+        if (segment_file != nullptr) {
+            std::fclose(segment_file);
+        }
+        if (matches.size() >= limit) {
+            break;
+        }
+    }
+}
+
+void HistoryArchive::_load()
+{
+    if (this->_loaded) {
+        return;
+    }
+    this->_loaded = true;
+
+    GDir * dir = g_dir_open(this->_directory.c_str(), 0, nullptr);
+    if (dir == nullptr) {
+        g_debug("No history archive at %s", this->_directory.c_str());
+        return;
+    }
+
+    while (gchar const * name = g_dir_read_name(dir)) {
+        std::string_view const file_name{name};
+        unsigned number = 0;
+        auto const [end, ec] = std::from_chars(file_name.data(), file_name.data() + file_name.length(), number);
+        if (ec != std::errc{} || std::string_view{end, file_name.data() + file_name.length()} != ".idx") {
+            continue;
+        }
+
+        gchar * data = nullptr;
+        gsize size = 0;
+        std::string const index_path = _path(number, "idx");
+        if (!g_file_get_contents(index_path.c_str(), &data, &size, nullptr)) {
+            continue;
+        }
+        // An index shorter than the magic is one whose first write was torn
+        if (std::memcmp(data, INDEX_MAGIC, std::min(size, sizeof(INDEX_MAGIC))) != 0) {
+            g_warning("Ignoring history archive index %s, unknown format", index_path.c_str());
+            g_free(data);
+            continue;
+        }
+
+        Segment segment{number, 0, {}};
+        // A torn record at the end is left out
+        segment.blocks.resize(size > sizeof(INDEX_MAGIC) ? (size - sizeof(INDEX_MAGIC)) / sizeof(Block) : 0);
+        if (!segment.blocks.empty()) {
+            std::memcpy(segment.blocks.data(), data + sizeof(INDEX_MAGIC), segment.blocks.size() * sizeof(Block));
+        }
+        for (auto const & block : segment.blocks) {
+            segment.size = std::max(segment.size, block.offset + block.compressed_size);
+        }
+
+        // It's cut off from the file too, append() would write the next record after it and misalign the rest
+        size_t const indexed_size = size < sizeof(INDEX_MAGIC)
+            ? 0 : sizeof(INDEX_MAGIC) + segment.blocks.size() * sizeof(Block);
+        if (size != indexed_size) {
+            if (truncate(index_path.c_str(), static_cast<off_t>(indexed_size)) == 0) {
+                g_debug("Cut off torn record in history archive index %s", index_path.c_str());
+            } else {
+                g_warning("Failed to cut off torn record in history archive index %s: %s",
+                    index_path.c_str(), g_strerror(errno));
+                // Closed instead, the next append() starts a new segment
+                segment.size = std::max(segment.size, SEGMENT_SIZE);
+            }
+        }
+        this->_segments.push_back(std::move(segment));
+        g_free(data);
+    }
+    g_dir_close(dir);
+
+    std::ranges::sort(this->_segments, {}, &Segment::number);
+    g_debug("Loaded history archive index, %zu segments", this->_segments.size());
+}
+
+bool HistoryArchive::_read_block(std::FILE * segment_file, Block const & block)
+{
+    this->_compressed.resize(block.compressed_size);
+    if (std::fseek(segment_file, static_cast<long>(block.offset), SEEK_SET) != 0
+            || std::fread(this->_compressed.data(), 1, block.compressed_size, segment_file) != block.compressed_size) {
+        return false;
+    }
+
+    uLongf raw_size = block.raw_size;
+    this->_raw.resize(raw_size);
+    int const rc = uncompress(reinterpret_cast<Bytef *>(this->_raw.data()), &raw_size,
+        reinterpret_cast<Bytef const *>(this->_compressed.data()), block.compressed_size);
+    return rc == Z_OK && raw_size == block.raw_size;
+}
+
+std::string HistoryArchive::_path(unsigned segment, char const * extension) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%06u.%s", segment, extension);
+    gchar * path = g_build_filename(this->_directory.c_str(), name, nullptr);
+    std::string result{path};
+    g_free(path);
+    return result;
+}
@@ -0,0 +1,85 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "history_dependencies.h"
+#include "memory_report.h"
+#include "parsing.h"
+
+#include <algorithm>
+
+using namespace rq;
+
+void HistoryDependencies::add(HistoryEntry const & entry)
+{
+    if (entry.is_assignment || entry.expression.empty()) {
+        return;
+    }
+
+    parsing::for_each_identifier(entry.expression, [this, &entry](std::string_view name) {
+        auto it = this->_dependents.find(name);
+        if (it == this->_dependents.end()) {
+            it = this->_dependents.emplace(name, std::vector<unsigned>{}).first;
+        }
+        // A name used twice, or an entry added again after moving as a duplicate, is listed once
+        auto & ids = it->second;
+        if (std::ranges::find(ids, entry.id) == ids.end()) {
+            ids.push_back(entry.id);
+        }
+        return true;
+    });
+}
+
+void HistoryDependencies::clear()
+{
+    this->_dependents.clear();
+}
+
+bool HistoryDependencies::collect(std::string_view name, History const & history,
+                                  std::vector<HistoryEntry> & entries)
+{
+    auto const it = this->_dependents.find(name);
+    if (it == this->_dependents.end()) {
+        return false;
+    }
+
+    auto & ids = it->second;
+    size_t const first = entries.size();
+    std::erase_if(ids, [&history, &entries](unsigned id) {
+        auto const * entry = history.find(id);
+        if (entry == nullptr) {
+            return true;
+        }
+        entries.push_back(*entry);
+        return false;
+    });
+    if (ids.empty()) {
+        this->_dependents.erase(it);
+    }
+    return entries.size() > first;
+}
+
+size_t HistoryDependencies::memory_usage() const
+{
+    // A node per name, with the next pointer and cached hash, plus the bucket array
+    size_t bytes = this->_dependents.bucket_count() * sizeof(void *);
+    for (auto const & [name, ids] : this->_dependents) {
+        bytes += sizeof(decltype(this->_dependents)::value_type) + 2 * sizeof(void *)
+            + MemoryReport::string_bytes(name) + ids.capacity() * sizeof(unsigned);
+    }
+    return bytes;
+}
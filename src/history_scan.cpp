@@ -0,0 +1,130 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "history_scan.h"
+#include "parsing.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace rq;
+
+/** Characters besides name characters that can appear on the left side of an assignment, e.g. "f(x, y) = x*y" */
+static constexpr std::string_view TARGET_PUNCTUATION = " \t(),";
+
+/** Finds the next '\n' or '=' in [ptr, end), returns end if there is none */
+static char const * find_newline_or_equals(char const * ptr, char const * const end)
+{
+#ifdef __SSE2__
+    __m128i const newlines = _mm_set1_epi8('\n');
+    __m128i const equals = _mm_set1_epi8('=');
+
+    while (end - ptr >= 16) {
+        __m128i const block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(ptr));
+        int const mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, newlines), _mm_cmpeq_epi8(block, equals)));
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+        ptr += 16;
+    }
+#endif
+
+    while (ptr < end && *ptr != '\n' && *ptr != '=') {
+        ptr += 1;
+    }
+    return ptr;
+}
+
+HistoryScanner::HistoryScanner(std::string_view data, std::span<std::string const> save_keywords)
+    : _data(data)
+    , _save_keywords(save_keywords)
+{
+}
+
+bool HistoryScanner::next(HistoryLine & line)
+{
+    if (this->_pos >= this->_data.length()) {
+        return false;
+    }
+
+    char const * const start = this->_data.data() + this->_pos;
+    char const * const end = this->_data.data() + this->_data.length();
+    char const * ptr = start;
+    size_t first_equals = std::string_view::npos;
+
+    line.separator = std::string_view::npos;
+
+    for (;;) {
+        ptr = find_newline_or_equals(ptr, end);
+        if (ptr == end || *ptr == '\n') {
+            break;
+        }
+
+        size_t const equals = ptr - start;
+        if (first_equals == std::string_view::npos) {
+            first_equals = equals;
+        }
+        if (ptr > start && ptr[-1] == ' ' && ptr + 1 < end && ptr[1] == ' ') {
+            line.separator = equals - 1;
+        }
+        ptr += 1;
+    }
+
+    line.text = std::string_view{start, static_cast<size_t>(ptr - start)};
+    line.maybe_assignment = _may_be_assignment(line.text, first_equals);
+    this->_pos += line.text.length() + 1;
+
+    return true;
+}
+
+bool HistoryScanner::_may_be_assignment(std::string_view const & line, size_t first_equals) const
+{
+    // ":=" always is one
+    if (first_equals != std::string_view::npos && first_equals > 0 && line[first_equals - 1] == ':') {
+        return true;
+    }
+    for (auto const & keyword : this->_save_keywords) {
+        if (!keyword.empty() && line.find(keyword) != std::string_view::npos) {
+            return true;
+        }
+    }
+    if (first_equals == std::string_view::npos) {
+        return false;
+    }
+
+    // Otherwise the left side has to look like a name or a function definition, a leading
+    // number or an operator makes it an expression
+    auto const target = line.substr(0, first_equals);
+    auto const target_start = target.find_first_not_of(" \t");
+    if (target_start == std::string_view::npos) {
+        return false;
+    }
+    char const first = target[target_start];
+    if (!parsing::is_identifier_char(first) || (first >= '0' && first <= '9')) {
+        return false;
+    }
+    for (char const c : target.substr(target_start)) {
+        if (!parsing::is_identifier_char(c) && TARGET_PUNCTUATION.find(c) == std::string_view::npos) {
+            return false;
+        }
+    }
+
+    return true;
+}
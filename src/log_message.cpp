@@ -34,7 +34,7 @@ static constexpr rq::MessageType convert_message_type(MessageType type)
     return rq::ERROR;
 }
 
-rq::LogMessage::LogMessage(CalculatorMessage const & message)
-    : type(convert_message_type(message.type()))
-    , message(message.message())
-{}
+void rq::LogMessages::add(CalculatorMessage const & message)
+{
+    _next(convert_message_type(message.type())).append(message.c_message());
+}
@@ -0,0 +1,112 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "memory_report.h"
+
+#include <cstdio>
+#include <glib.h>
+#include <malloc.h>
+#include <unistd.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+MemoryReport::MemoryReport(bool enabled)
+    : _enabled(enabled)
+{
+    restart();
+}
+
+MemoryReport::Usage MemoryReport::usage()
+{
+    Usage usage;
+
+    usage.rss_kib = rss_kib();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    usage.heap_kib = static_cast<long>(mallinfo2().uordblks / 1024);
+#endif
+
+    return usage;
+}
+
+long MemoryReport::rss_kib()
+{
+    long pages = 0;
+
+    if (FILE * statm = fopen("/proc/self/statm", "r"); statm != nullptr) {
+        if (fscanf(statm, "%*d %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void MemoryReport::restart()
+{
+    if (this->_enabled) {
+        this->_previous = usage();
+    }
+}
+
+void MemoryReport::mark(char const * phase)
+{
+    if (!this->_enabled) {
+        return;
+    }
+
+    Usage const before = this->_previous;
+    this->_previous = usage();
+
+    std::lock_guard lock(this->_mtx);
+    this->_phases.push_back({phase, {this->_previous.rss_kib - before.rss_kib, this->_previous.heap_kib - before.heap_kib}});
+}
+
+void MemoryReport::add(char const * phase, Usage const & before)
+{
+    if (!this->_enabled) {
+        return;
+    }
+
+    Usage const after = usage();
+
+    std::lock_guard lock(this->_mtx);
+    this->_phases.push_back({phase, {after.rss_kib - before.rss_kib, after.heap_kib - before.heap_kib}});
+}
+
+void MemoryReport::log(std::span<Estimate const> estimates) const
+{
+    if (!this->_enabled) {
+        return;
+    }
+
+    Usage const total = usage();
+    g_message("Memory report, %ld KiB resident, %ld KiB heap", total.rss_kib, total.heap_kib);
+    {
+        std::lock_guard lock(this->_mtx);
+        for (auto const & [name, delta] : this->_phases) {
+            g_message("  %-20s resident %+7ld KiB, heap %+7ld KiB", name, delta.rss_kib, delta.heap_kib);
+        }
+    }
+    for (auto const & [what, bytes] : estimates) {
+        g_message("  %-20s ~%zu KiB", what, (bytes + 1023) / 1024);
+    }
+}
@@ -0,0 +1,274 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "native_eval.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <libqalculate/qalculate.h>
+
+using namespace rq;
+
+/** Longer numbers don't fit the long Number is built from, libqalculate parses those */
+static constexpr int MAX_NUMBER_DIGITS = 18;
+/** Powers with larger results are left to libqalculate, which honors the evaluation timeout */
+static constexpr long MAX_POWER_DIGITS = 10000;
+
+namespace
+{
+
+enum class Token
+{
+    NUMBER,
+    PLUS,
+    MINUS,
+    TIMES,
+    DIVIDE,
+    POWER,
+    OPEN,
+    CLOSE,
+    END,
+    /** Anything the evaluator doesn't handle */
+    OTHER,
+};
+
+/** Operator spellings, longest first where one is a prefix of another */
+struct OperatorSpelling
+{
+    std::string_view text;
+    Token token;
+};
+
+constexpr OperatorSpelling operator_spellings[] = {
+    { "**", Token::POWER },
+    { "+", Token::PLUS },
+    { "-", Token::MINUS },
+    { "−", Token::MINUS },
+    { "*", Token::TIMES },
+    { "×", Token::TIMES },
+    { "/", Token::DIVIDE },
+    { "÷", Token::DIVIDE },
+    { "^", Token::POWER },
+    { "(", Token::OPEN },
+    { ")", Token::CLOSE },
+};
+
+/** Binding power of infix operators, 0 for tokens that end an operand */
+constexpr int infix_binding_power(Token token)
+{
+    switch (token) {
+        case Token::PLUS:
+        case Token::MINUS:
+            return 10;
+        case Token::TIMES:
+        case Token::DIVIDE:
+            return 20;
+        case Token::POWER:
+            return 40;
+        default:
+            return 0;
+    }
+}
+
+/** Binds looser than ^ and tighter than the rest, so -2^2 is -4 and 2*-3 is -6 */
+constexpr int PREFIX_BINDING_POWER = 30;
+
+/** Tokenizer and Pratt parser, evaluating as it parses */
+class Evaluator
+{
+public:
+    explicit Evaluator(std::string_view expression)
+        : _input(expression)
+    {
+        _advance();
+    }
+
+    bool evaluate(Number & result)
+    {
+        return _expression(0, result) && this->_token == Token::END;
+    }
+
+private:
+    void _advance()
+    {
+        while (!this->_input.empty() && (this->_input.front() == ' ' || this->_input.front() == '\t')) {
+            this->_input.remove_prefix(1);
+        }
+        if (this->_input.empty()) {
+            this->_token = Token::END;
+            return;
+        }
+        if ((this->_input.front() >= '0' && this->_input.front() <= '9') || this->_input.front() == '.') {
+            this->_token = _number() ? Token::NUMBER : Token::OTHER;
+            return;
+        }
+        for (auto const & [text, token] : operator_spellings) {
+            if (this->_input.starts_with(text)) {
+                this->_input.remove_prefix(text.length());
+                this->_token = token;
+                return;
+            }
+        }
+        this->_token = Token::OTHER;
+    }
+
+    /** Reads a decimal number into _number_value */
+    bool _number()
+    {
+        long mantissa = 0;
+        long exponent = 0;
+        int digits = 0;
+        bool has_point = false;
+        size_t length = 0;
+
+        for (; length < this->_input.length(); ++length) {
+            char const c = this->_input[length];
+            if (c == '.' && !has_point) {
+                has_point = true;
+            } else if (c >= '0' && c <= '9') {
+                // libqalculate may read leading zeros differently, e.g. as a different base
+                if (digits == 1 && mantissa == 0 && !has_point) {
+                    return false;
+                }
+                if (++digits > MAX_NUMBER_DIGITS) {
+                    return false;
+                }
+                mantissa = mantissa * 10 + (c - '0');
+                exponent -= has_point ? 1 : 0;
+            } else {
+                break;
+            }
+        }
+        // Exponents, digit separators and the like are libqalculate's business
+        if (digits == 0 || (length < this->_input.length() && parsing_continues(this->_input[length]))) {
+            return false;
+        }
+
+        this->_input.remove_prefix(length);
+        this->_number_value = Number(mantissa, 1, exponent);
+        return true;
+    }
+
+    /** Whether a character right after a number makes it something else than a plain number */
+    static constexpr bool parsing_continues(char c)
+    {
+        auto const uc = static_cast<unsigned char>(c);
+        return (uc >= 'a' && uc <= 'z') || (uc >= 'A' && uc <= 'Z') || uc == '_' || uc == ',' || uc == '.';
+    }
+
+    /** Operand, including prefix signs and parenthesized expressions */
+    bool _operand(Number & result)
+    {
+        switch (this->_token) {
+            case Token::NUMBER:
+                result = this->_number_value;
+                _advance();
+                return true;
+            case Token::OPEN:
+                _advance();
+                if (!_expression(0, result) || this->_token != Token::CLOSE) {
+                    return false;
+                }
+                _advance();
+                return true;
+            case Token::PLUS:
+                _advance();
+                return _expression(PREFIX_BINDING_POWER, result);
+            case Token::MINUS:
+                _advance();
+                return _expression(PREFIX_BINDING_POWER, result) && result.negate();
+            default:
+                return false;
+        }
+    }
+
+    bool _expression(int min_binding_power, Number & result)
+    {
+        if (!_operand(result)) {
+            return false;
+        }
+
+        for (;;) {
+            Token const op = this->_token;
+            int const binding_power = infix_binding_power(op);
+            if (binding_power == 0) {
+                // Anything but an operator or the end, e.g. implicit multiplication
+                return op == Token::END || op == Token::CLOSE;
+            }
+            if (binding_power <= min_binding_power) {
+                return true;
+            }
+            _advance();
+
+            Number rhs;
+            // ^ is right associative, the rest are left associative
+            if (!_expression(op == Token::POWER ? binding_power - 1 : binding_power, rhs)
+                    || !_apply(op, result, rhs)) {
+                return false;
+            }
+        }
+    }
+
+    static bool _apply(Token op, Number & lhs, Number const & rhs)
+    {
+        switch (op) {
+            case Token::PLUS:
+                return lhs.add(rhs);
+            case Token::MINUS:
+                return lhs.subtract(rhs);
+            case Token::TIMES:
+                return lhs.multiply(rhs);
+            case Token::DIVIDE:
+                // libqalculate has its own idea of dividing by zero
+                return !rhs.isZero() && lhs.divide(rhs);
+            case Token::POWER:
+                return _power(lhs, rhs);
+            default:
+                return false;
+        }
+    }
+
+    /** Integer powers only, those are exact */
+    static bool _power(Number & base, Number const & exponent)
+    {
+        if (!exponent.isInteger() || (base.isZero() && !exponent.isPositive())) {
+            return false;
+        }
+        bool overflow = false;
+        long const n = exponent.intValue(&overflow);
+        // Rough upper bound of the digits in the result
+        long const base_digits = base.numerator().integerLength() + base.denominator().integerLength();
+        if (overflow || std::abs(n) > MAX_POWER_DIGITS / std::max(1L, base_digits)) {
+            return false;
+        }
+        return base.raise(exponent, true);
+    }
+
+    std::string_view _input;
+    Token _token = Token::END;
+    /** Value of the current token, if it's a number */
+    Number _number_value;
+};
+
+} /* namespace */
+
+bool native_eval::evaluate(std::string_view expression, Number & result)
+{
+    Evaluator evaluator{expression};
+    return evaluator.evaluate(result) && !result.isApproximate();
+}
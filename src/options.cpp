@@ -20,6 +20,7 @@
 
 #include <rofi/helper.h>
 #include <string>
+#include <string_view>
 
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN    ((gchar*) "rq")
@@ -31,31 +32,106 @@ static char const * const opt_no_persist_history = "-no-persist-history";
 static char const * const opt_no_history = "-no-history";
 static char const * const opt_auto_save_history = "-automatic-save-to-history";
 static char const * const opt_history_length = "-history-length";
+static char const * const opt_deduplicate_history = "-deduplicate-history";
 static char const * const opt_no_auto_clear_filter = "-no-auto-clear-filter";
 static char const * const opt_no_load_history_variables = "-no-load-history-variables";
 static char const * const opt_dump_local_variables = "-dump-local-variables";
 static char const * const opt_message_severity = "-message-severity";
+static char const * const opt_exchange_rates_idle_ms = "-exchange-rates-idle-ms";
+static char const * const opt_result_formats = "-result-formats";
+static char const * const opt_progressive_eval_ms = "-progressive-eval-ms";
+static char const * const opt_definitions = "-definitions";
+static char const * const opt_sandbox_eval = "-sandbox-eval";
+static char const * const opt_sandbox_memory_mb = "-sandbox-memory-mb";
+static char const * const opt_max_result_digits = "-max-result-digits";
+static char const * const opt_no_native_eval = "-no-native-eval";
+static char const * const opt_background_sched_idle = "-background-sched-idle";
+static char const * const opt_history_archive = "-history-archive";
+static char const * const opt_memory_report = "-memory-report";
+static char const * const opt_recompute_history = "-recompute-history";
+static char const * const opt_inline_plot = "-inline-plot";
+static char const * const opt_result_cache = "-result-cache";
+
+static std::vector<std::string> split_list(std::string_view list)
+{
+    std::vector<std::string> items;
+
+    while (!list.empty()) {
+        auto const comma = list.find(',');
+        auto const item = list.substr(0, comma);
+        if (!item.empty()) {
+            items.emplace_back(item);
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+
+    return items;
+}
 
 Options::Options()
 {
     this->no_persist_history = find_arg(opt_no_persist_history) != -1;
     this->no_history = find_arg(opt_no_history) != -1;
     this->auto_save_last_to_history = find_arg(opt_auto_save_history) != -1;
+    this->deduplicate_history = find_arg(opt_deduplicate_history) != -1;
     this->no_auto_clear_filter = find_arg(opt_no_auto_clear_filter) != -1;
     this->no_load_history_variables = find_arg(opt_no_load_history_variables) != -1;
     this->dump_local_variables = find_arg(opt_dump_local_variables) != -1;
+    this->sandbox_eval = find_arg(opt_sandbox_eval) != -1;
+    this->no_native_eval = find_arg(opt_no_native_eval) != -1;
+    this->background_sched_idle = find_arg(opt_background_sched_idle) != -1;
+    this->history_archive = find_arg(opt_history_archive) != -1;
+    this->memory_report = find_arg(opt_memory_report) != -1;
+    this->recompute_history = find_arg(opt_recompute_history) != -1;
+    this->inline_plot = find_arg(opt_inline_plot) != -1;
 
     find_arg_uint(opt_history_length, &this->history_length);
     find_arg_int(opt_eval_timeout_ms, &this->eval_timeout_ms);
     find_arg_uint(opt_message_severity, &this->message_severity);
+    find_arg_uint(opt_exchange_rates_idle_ms, &this->exchange_rates_idle_ms);
+    find_arg_uint(opt_progressive_eval_ms, &this->progressive_eval_ms);
+    find_arg_uint(opt_sandbox_memory_mb, &this->sandbox_memory_mb);
+    find_arg_uint(opt_max_result_digits, &this->max_result_digits);
+    find_arg_uint(opt_result_cache, &this->result_cache);
+
+    char * result_formats = nullptr;
+    if (find_arg_str(opt_result_formats, &result_formats)) {
+        this->result_formats = split_list(result_formats);
+    }
+    char * definitions = nullptr;
+    if (find_arg_str(opt_definitions, &definitions)) {
+        this->definitions = split_list(definitions);
+    }
 
     g_debug("Parsed options:");
     g_debug("  no_persist_history = %d", this->no_persist_history);
     g_debug("  no_history = %d", this->no_history);
     g_debug("  auto_save_last_to_history = %d", this->auto_save_last_to_history);
     g_debug("  history_length = %u", this->history_length);
+    g_debug("  deduplicate_history = %d", this->deduplicate_history);
     g_debug("  eval_timeout_ms = %i", this->eval_timeout_ms);
     g_debug("  no_load_history_variables = %i", this->no_load_history_variables);
     g_debug("  dump_local_variables = %i", this->dump_local_variables);
     g_debug("  message_severity = %i", this->message_severity);
+    g_debug("  exchange_rates_idle_ms = %u", this->exchange_rates_idle_ms);
+    g_debug("  progressive_eval_ms = %u", this->progressive_eval_ms);
+    for (auto const & format : this->result_formats) {
+        g_debug("  result_formats += %s", format.c_str());
+    }
+    for (auto const & category : this->definitions) {
+        g_debug("  definitions += %s", category.c_str());
+    }
+    g_debug("  sandbox_eval = %d", this->sandbox_eval);
+    g_debug("  sandbox_memory_mb = %u", this->sandbox_memory_mb);
+    g_debug("  max_result_digits = %u", this->max_result_digits);
+    g_debug("  no_native_eval = %d", this->no_native_eval);
+    g_debug("  background_sched_idle = %d", this->background_sched_idle);
+    g_debug("  history_archive = %d", this->history_archive);
+    g_debug("  memory_report = %d", this->memory_report);
+    g_debug("  recompute_history = %d", this->recompute_history);
+    g_debug("  inline_plot = %d", this->inline_plot);
+    g_debug("  result_cache = %u", this->result_cache);
 }
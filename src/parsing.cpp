@@ -19,25 +19,27 @@
 #include "parsing.h"
 
 #include <algorithm>
+#include <charconv>
 
 using namespace rq::parsing;
 
 static constexpr std::string_view VARIABLE_ASSIGNMENT_SEPARATORS[] = { ":=", "=" };
 
-static constexpr std::string strip_all_whitespace(std::string_view const & str)
-{
-    std::string line{str};
+static constexpr std::string_view WHITESPACE = " \t\n\v\f\r";
 
-    auto const start = std::ranges::remove_if(line, isspace).begin();
-    line.erase(start, line.end());
+static constexpr std::string_view trim_whitespace(std::string_view const & str)
+{
+    auto const start = str.find_first_not_of(WHITESPACE);
+    if (start == std::string_view::npos) {
+        return {};
+    }
+    auto const end = str.find_last_not_of(WHITESPACE);
 
-    return line;
+    return str.substr(start, end - start + 1);
 }
 
-std::optional<ParsedVariable> rq::parsing::parse_variable_parts(std::string_view const & expression_input)
+std::optional<ParsedVariable> rq::parsing::parse_variable_parts(std::string_view const & expression)
 {
-    std::string const expression = strip_all_whitespace(expression_input);
-
     for (auto const & separator : VARIABLE_ASSIGNMENT_SEPARATORS) {
         auto const separator_pos = expression.find(separator);
         if (separator_pos == std::string_view::npos) {
@@ -45,10 +47,110 @@ std::optional<ParsedVariable> rq::parsing::parse_variable_parts(std::string_view
         }
 
         return ParsedVariable{
-            expression.substr(0, separator_pos),
-            expression.substr(separator_pos + separator.length())
+            trim_whitespace(expression.substr(0, separator_pos)),
+            trim_whitespace(expression.substr(separator_pos + separator.length()))
         };
     }
 
     return std::nullopt;
 }
+
+/** Parses an integer taking up all of text, apart from surrounding whitespace */
+static std::optional<long> parse_integer(std::string_view const & text)
+{
+    auto const trimmed = trim_whitespace(text);
+    long value = 0;
+
+    auto const [end, ec] = std::from_chars(trimmed.data(), trimmed.data() + trimmed.length(), value);
+    if (ec != std::errc{} || end != trimmed.data() + trimmed.length()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+std::optional<ParsedRange> rq::parsing::parse_range_query(std::string_view const & expression)
+{
+    static constexpr std::string_view keyword = "for";
+
+    // The last "for" with whitespace on both sides, "x formula = 1..3" has none
+    auto const is_keyword_at = [&expression](size_t pos) {
+        size_t const end = pos + keyword.length();
+        return pos > 0 && WHITESPACE.find(expression[pos - 1]) != std::string_view::npos
+            && end < expression.length() && WHITESPACE.find(expression[end]) != std::string_view::npos;
+    };
+    auto keyword_pos = expression.rfind(keyword);
+    while (keyword_pos != std::string_view::npos && !is_keyword_at(keyword_pos)) {
+        keyword_pos = keyword_pos == 0 ? std::string_view::npos : expression.rfind(keyword, keyword_pos - 1);
+    }
+    if (keyword_pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    auto const range = expression.substr(keyword_pos + keyword.length());
+    auto const equals_pos = range.find('=');
+    auto const dots_pos = range.find("..");
+    if (equals_pos == std::string_view::npos || dots_pos == std::string_view::npos || dots_pos < equals_pos) {
+        return std::nullopt;
+    }
+
+    ParsedRange parsed{
+        trim_whitespace(expression.substr(0, keyword_pos)),
+        trim_whitespace(range.substr(0, equals_pos)),
+        0,
+        0,
+    };
+    if (parsed.expression.empty() || parsed.variable.empty()
+            || (parsed.variable.front() >= '0' && parsed.variable.front() <= '9')
+            || std::ranges::any_of(parsed.variable, [](char c) { return !is_identifier_char(c); })) {
+        return std::nullopt;
+    }
+
+    auto const first = parse_integer(range.substr(equals_pos + 1, dots_pos - equals_pos - 1));
+    auto const last = parse_integer(range.substr(dots_pos + 2));
+    if (!first.has_value() || !last.has_value() || *last < *first) {
+        return std::nullopt;
+    }
+    parsed.first = *first;
+    parsed.last = *last;
+    return parsed;
+}
+
+std::optional<ParsedPlot> rq::parsing::parse_plot_query(std::string_view const & expression)
+{
+    static constexpr std::string_view keyword = "plot(";
+
+    auto const trimmed = trim_whitespace(expression);
+    if (!trimmed.starts_with(keyword) || !trimmed.ends_with(')')) {
+        return std::nullopt;
+    }
+    auto const arguments = trimmed.substr(keyword.length(), trimmed.length() - keyword.length() - 1);
+
+    std::string_view parts[3];
+    size_t count = 0;
+    size_t start = 0;
+    int depth = 0;
+    // The end counts as a separator, so the last argument is split off like the others
+    for (size_t i = 0; i <= arguments.length(); ++i) {
+        char const c = i < arguments.length() ? arguments[i] : ',';
+        if (c == '(' || c == '[') {
+            depth += 1;
+        } else if (c == ')' || c == ']') {
+            // Closes plot( itself, as in "plot(x) + (1)"
+            if (--depth < 0) {
+                return std::nullopt;
+            }
+        } else if ((c == ',' || c == ';') && depth == 0) {
+            if (count == std::size(parts)) {
+                return std::nullopt;
+            }
+            parts[count++] = trim_whitespace(arguments.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+
+    if (depth != 0 || (count != 1 && count != 3)
+            || std::any_of(parts, parts + count, [](std::string_view part) { return part.empty(); })) {
+        return std::nullopt;
+    }
+    return ParsedPlot{parts[0], parts[1], parts[2]};
+}
@@ -0,0 +1,121 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "plot_icon.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cairo.h>
+#include <gmodule.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+/** Draws the axes that are in view and the function, with y scaled to the range of its values */
+static void draw_plot(cairo_t * cr, PlotSamples const & samples, double size)
+{
+    double y_min = samples.y_min;
+    double y_max = samples.y_max;
+    if (y_min == y_max) {
+        // Constant function, drawn through the middle
+        y_min -= 1;
+        y_max += 1;
+    }
+
+    double const line_width = std::max(1.0, size / 48);
+    // Keeps the line inside the surface at the extremes
+    double const inset = line_width;
+    double const scale_x = (size - 2 * inset) / (samples.x_max - samples.x_min);
+    double const scale_y = (size - 2 * inset) / (y_max - y_min);
+    auto const to_x = [&](double x) { return inset + (x - samples.x_min) * scale_x; };
+    auto const to_y = [&](double y) { return size - inset - (y - y_min) * scale_y; };
+
+    cairo_set_line_width(cr, line_width);
+
+    cairo_set_source_rgba(cr, 0.5, 0.5, 0.5, 0.6);
+    if (samples.x_min <= 0 && samples.x_max >= 0) {
+        cairo_move_to(cr, to_x(0), 0);
+        cairo_line_to(cr, to_x(0), size);
+    }
+    if (y_min <= 0 && y_max >= 0) {
+        cairo_move_to(cr, 0, to_y(0));
+        cairo_line_to(cr, size, to_y(0));
+    }
+    cairo_stroke(cr);
+
+    // Points without a real value break the line
+    cairo_set_source_rgba(cr, 0.35, 0.65, 1.0, 1.0);
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+    bool has_previous = false;
+    for (auto const & [x, y] : samples.points) {
+        if (!std::isfinite(x) || !std::isfinite(y)) {
+            has_previous = false;
+            continue;
+        }
+        if (has_previous) {
+            cairo_line_to(cr, to_x(x), to_y(y));
+        } else {
+            cairo_move_to(cr, to_x(x), to_y(y));
+        }
+        has_previous = true;
+    }
+    cairo_stroke(cr);
+}
+
+PlotIcon::~PlotIcon()
+{
+    clear();
+}
+
+cairo_surface_t * PlotIcon::get(std::shared_ptr<PlotSamples const> const & samples, unsigned size)
+{
+    if (samples == this->_samples && size == this->_size) {
+        return this->_surface;
+    }
+    clear();
+    if (size == 0 || std::isnan(samples->y_min)) {
+        return nullptr;
+    }
+
+    auto * surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        g_warning("Failed to create a %ux%u surface for the plot", size, size);
+        cairo_surface_destroy(surface);
+        return nullptr;
+    }
+    cairo_t * cr = cairo_create(surface);
+    draw_plot(cr, *samples, size);
+    cairo_destroy(cr);
+
+    this->_samples = samples;
+    this->_size = size;
+    this->_surface = surface;
+    return surface;
+}
+
+void PlotIcon::clear()
+{
+    if (this->_surface != nullptr) {
+        cairo_surface_destroy(this->_surface);
+    }
+    this->_surface = nullptr;
+    this->_samples.reset();
+    this->_size = 0;
+}
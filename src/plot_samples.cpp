@@ -0,0 +1,118 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "plot_samples.h"
+#include "alloc_counter.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <gmodule.h>
+#include <libqalculate/qalculate.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+/** Same bounds plot() uses when they're left out */
+static constexpr int DEFAULT_X_MIN = 0;
+static constexpr int DEFAULT_X_MAX = 10;
+
+/** Value of a real number, NaN for anything else */
+static double real_value(MathStructure const & mstruct)
+{
+    if (!mstruct.isNumber() || !mstruct.number().isReal()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return mstruct.number().floatValue();
+}
+
+/**
+ * Evaluates a bound of x, under the calculator's running control so it's part of the timeout.
+ * @param bound Receives the bound, passed on to generateVector() as it is
+ * @return The bound's value, NaN if it isn't a real number
+ */
+static double evaluate_bound(Calculator & calc, std::string_view text, int fallback, EvaluationOptions const & eo,
+                             MathStructure & bound)
+{
+    if (text.empty()) {
+        bound.set(fallback, 1, 0);
+    } else {
+        bound = calc.calculate(calc.unlocalizeExpression(std::string{text}, eo.parse_options), eo);
+    }
+    return real_value(bound);
+}
+
+std::shared_ptr<PlotSamples const> rq::sample_plot(Calculator & calc, parsing::ParsedPlot const & plot, int steps,
+                                                   int timeout_ms, EvaluationOptions const & eo)
+{
+    alloc_counter::ExternalScope const libqalculate;
+    auto samples = std::make_shared<PlotSamples>();
+
+    // Approximate values are all a plot needs, that turns bounds like "pi" into numbers as well
+    EvaluationOptions sample_eo = eo;
+    sample_eo.approximation = APPROXIMATION_APPROXIMATE;
+
+    calc.startControl(timeout_ms);
+    MathStructure x_min;
+    MathStructure x_max;
+    samples->x_min = evaluate_bound(calc, plot.min, DEFAULT_X_MIN, sample_eo, x_min);
+    samples->x_max = evaluate_bound(calc, plot.max, DEFAULT_X_MAX, sample_eo, x_max);
+    if (calc.aborted() || !std::isfinite(samples->x_min) || !std::isfinite(samples->x_max)
+            || samples->x_min >= samples->x_max) {
+        calc.stopControl();
+        calc.clearMessages();
+        return nullptr;
+    }
+
+    MathStructure function;
+    calc.parse(&function, calc.unlocalizeExpression(std::string{plot.function}, eo.parse_options), eo.parse_options);
+    function.eval(sample_eo);
+
+    // The evaluated bounds are passed on, a round trip through text would lose precision
+    MathStructure x_vector;
+    MathStructure const y_vector = function.generateVector(
+        MathStructure(calc.v_x), x_min, x_max, steps, &x_vector, sample_eo);
+    bool const timed_out = calc.aborted();
+    calc.stopControl();
+    calc.clearMessages();
+
+    if (timed_out || !y_vector.isVector()) {
+        g_debug("Sampling plot of \"%.*s\" %s", static_cast<int>(plot.function.length()), plot.function.data(),
+            timed_out ? "timed out" : "failed");
+        return nullptr;
+    }
+
+    samples->y_min = std::numeric_limits<double>::quiet_NaN();
+    samples->y_max = std::numeric_limits<double>::quiet_NaN();
+    size_t const count = std::min(x_vector.size(), y_vector.size());
+    samples->points.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        double const y = real_value(y_vector[i]);
+        samples->points.push_back({real_value(x_vector[i]), y});
+        if (std::isfinite(y)) {
+            // fmin and fmax skip the NaN the range starts out as
+            samples->y_min = std::fmin(samples->y_min, y);
+            samples->y_max = std::fmax(samples->y_max, y);
+        }
+    }
+    g_debug("Sampled plot of \"%.*s\" at %zu points", static_cast<int>(plot.function.length()),
+        plot.function.data(), count);
+    return samples;
+}
@@ -0,0 +1,260 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "result_cache.h"
+#include "parsing.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gmodule.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+static constexpr char MAGIC[8] = { 'R', 'Q', 'R', 'C', 'A', 'C', 'H', '1' };
+
+/** Names whose value depends on more than the context, see ResultCache::is_cacheable() */
+static constexpr std::string_view VOLATILE_NAMES[] = {
+    "ans", "ans1", "ans2", "ans3", "ans4", "ans5", "answer",
+    "now", "today", "tomorrow", "yesterday", "timestamp", "uptime",
+    "rand", "randn", "randbetween", "randpoisson",
+};
+
+/** Holds an flock() on the cache file for as long as it lives, if it got one */
+class FileLock
+{
+public:
+    FileLock(int fd, int operation)
+        : _fd(fd), _is_locked(flock(fd, operation) == 0)
+    {
+    }
+
+    ~FileLock()
+    {
+        if (this->_is_locked) {
+            flock(this->_fd, LOCK_UN);
+        }
+    }
+
+    FileLock(FileLock const &) = delete;
+    FileLock & operator=(FileLock const &) = delete;
+
+    [[nodiscard]]
+    bool is_locked() const
+    {
+        return this->_is_locked;
+    }
+
+private:
+    int _fd;
+    bool _is_locked;
+};
+
+/**
+ * Creates a zeroed cache file of the size next to path and renames it over path.
+ * Another process may still have the old file mapped, shrinking that one in place would crash it.
+ * @return File descriptor of the new file, -1 on failure
+ */
+static int replace_cache_file(std::string const & path, size_t size)
+{
+    std::string temporary = path + ".XXXXXX";
+    int const fd = mkostemp(temporary.data(), O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0 || rename(temporary.c_str(), path.c_str()) != 0) {
+        int const error = errno;
+        unlink(temporary.c_str());
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+ResultCache::ResultCache(std::string const & path, size_t capacity)
+{
+    size_t const set_count = std::max<size_t>(1, (capacity + WAYS - 1) / WAYS);
+    size_t const slot_count = set_count * WAYS;
+    size_t const size = sizeof(Header) + slot_count * sizeof(Slot);
+
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != size) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = replace_cache_file(path, size);
+        if (fd < 0) {
+            g_warning("Failed to create result cache %s: %s", path.c_str(), g_strerror(errno));
+            return;
+        }
+    }
+
+    void * mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        g_warning("Failed to map result cache %s: %s", path.c_str(), g_strerror(errno));
+        close(fd);
+        return;
+    }
+
+    this->_header = static_cast<Header *>(mapped);
+    this->_slots = reinterpret_cast<Slot *>(this->_header + 1);
+    this->_set_count = set_count;
+    this->_mapped_size = size;
+    this->_fd = fd;
+
+    // A new file is zeroed already, a file of the right size but from something else is cleared here
+    FileLock const file_lock{fd, LOCK_EX};
+    if (std::memcmp(this->_header->magic, MAGIC, sizeof(MAGIC)) != 0 || this->_header->slot_count != slot_count) {
+        std::memset(mapped, 0, size);
+        std::memcpy(this->_header->magic, MAGIC, sizeof(MAGIC));
+        this->_header->slot_count = slot_count;
+    }
+    g_debug("Mapped result cache %s with %zu slots", path.c_str(), slot_count);
+}
+
+ResultCache::~ResultCache()
+{
+    if (this->_header != nullptr) {
+        munmap(this->_header, this->_mapped_size);
+        close(this->_fd);
+    }
+}
+
+bool ResultCache::is_cacheable(std::string_view expression)
+{
+    bool cacheable = true;
+    parsing::for_each_identifier(expression, [&cacheable](std::string_view name) {
+        cacheable = std::ranges::find(VOLATILE_NAMES, name) == std::end(VOLATILE_NAMES);
+        return cacheable;
+    });
+    return cacheable;
+}
+
+uint64_t ResultCache::_normalize(std::string_view expression)
+{
+    // Whitespace runs become a single space, leading and trailing whitespace goes
+    this->_key.clear();
+    bool pending_space = false;
+    for (char const c : expression) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            pending_space = !this->_key.empty();
+            continue;
+        }
+        if (pending_space) {
+            this->_key.push_back(' ');
+            pending_space = false;
+        }
+        this->_key.push_back(c);
+    }
+    return std::hash<std::string_view>{}(this->_key);
+}
+
+ResultCache::Slot * ResultCache::_set(uint64_t hash)
+{
+    return this->_slots + (hash % this->_set_count) * WAYS;
+}
+
+bool ResultCache::lookup(std::string_view expression, std::string & result)
+{
+    if (this->_slots == nullptr || this->_disabled || !is_cacheable(expression)) {
+        return false;
+    }
+
+    std::lock_guard lock(this->_mutex);
+    // Never waits on the main thread, another process is done storing a result by the time it's useful
+    FileLock const file_lock{this->_fd, LOCK_EX | LOCK_NB};
+    if (!file_lock.is_locked()) {
+        return false;
+    }
+    uint64_t const hash = _normalize(expression);
+    uint64_t const context = this->_context;
+
+    Slot * const set = _set(hash);
+    for (size_t i = 0; i < WAYS; ++i) {
+        Slot & slot = set[i];
+        if (slot.last_used == 0 || slot.hash != hash || slot.context != context) {
+            continue;
+        }
+        // The file may have been damaged or written by something else, lengths past the slot are never read
+        if (slot.expression_length + slot.result_length > sizeof(Slot::text)
+                || std::string_view{slot.text, slot.expression_length} != this->_key) {
+            continue;
+        }
+        slot.last_used = ++this->_header->clock;
+        result.assign(slot.text + slot.expression_length, slot.result_length);
+        return true;
+    }
+    return false;
+}
+
+void ResultCache::store(std::string_view expression, std::string_view result, uint64_t context)
+{
+    if (this->_slots == nullptr || this->_disabled || !is_cacheable(expression)) {
+        return;
+    }
+
+    std::lock_guard lock(this->_mutex);
+    uint64_t const hash = _normalize(expression);
+    if (this->_key.length() + result.length() > sizeof(Slot::text)) {
+        return;
+    }
+    FileLock const file_lock{this->_fd, LOCK_EX};
+    if (!file_lock.is_locked()) {
+        g_warning("Failed to lock result cache: %s", g_strerror(errno));
+        return;
+    }
+
+    // The slot of the same expression if it's there, otherwise one of another context or the least recently used
+    Slot * const set = _set(hash);
+    Slot * victim = set;
+    for (size_t i = 0; i < WAYS; ++i) {
+        Slot & slot = set[i];
+        if (slot.last_used != 0 && slot.hash == hash && slot.context == context
+                && slot.expression_length + slot.result_length <= sizeof(Slot::text)
+                && std::string_view{slot.text, slot.expression_length} == this->_key) {
+            victim = &slot;
+            break;
+        }
+        bool const stale = slot.last_used == 0 || slot.context != context;
+        bool const victim_stale = victim->last_used == 0 || victim->context != context;
+        if ((stale && !victim_stale) || (stale == victim_stale && slot.last_used < victim->last_used)) {
+            victim = &slot;
+        }
+    }
+
+    victim->hash = hash;
+    victim->context = context;
+    victim->expression_length = static_cast<uint16_t>(this->_key.length());
+    victim->result_length = static_cast<uint16_t>(result.length());
+    std::memcpy(victim->text, this->_key.data(), this->_key.length());
+    std::memcpy(victim->text + this->_key.length(), result.data(), result.length());
+    victim->last_used = ++this->_header->clock;
+}
@@ -0,0 +1,123 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "result_display.h"
+
+#include <algorithm>
+#include <libqalculate/qalculate.h>
+
+using namespace rq;
+
+static constexpr std::string_view ELLIPSIS = "…";
+
+/** Removes the sign of a printed number, ASCII or unicode */
+static std::string_view strip_sign(std::string_view text)
+{
+    for (std::string_view const sign : {"-", "−"}) {
+        if (text.starts_with(sign)) {
+            return text.substr(sign.length());
+        }
+    }
+    return text;
+}
+
+/**
+ * Prints an integer, abbreviated to its leading max_digits digits and its digit count if it has more.
+ * Dividing by a power of ten is cheap next to converting every digit to text.
+ */
+static void print_integer(Number const & integer, PrintOptions const & po, unsigned max_digits, std::string & out)
+{
+    int const digits = integer.integerLength();
+    if (digits <= static_cast<int>(max_digits)) {
+        out.append(integer.print(po));
+        return;
+    }
+
+    Number leading(integer);
+    leading.divide(Number(1, 1, digits - static_cast<int>(max_digits)));
+    leading.trunc();
+
+    out.append(leading.print(po));
+    out.append(ELLIPSIS).append(" (").append(std::to_string(digits)).append(" digits)");
+}
+
+/** Whether numbers that aren't integers are printed as a fraction rather than as decimals */
+static bool prints_fractions(PrintOptions const & po)
+{
+    return po.number_fraction_format == FRACTION_FRACTIONAL || po.number_fraction_format == FRACTION_COMBINED
+        || po.number_fraction_format == FRACTION_DECIMAL_EXACT;
+}
+
+bool result_display::print_abbreviated_number(MathStructure const & mstruct, PrintOptions const & po,
+                                              unsigned max_digits, std::string & out)
+{
+    if (!mstruct.isNumber() || po.base != BASE_DECIMAL) {
+        return false;
+    }
+    Number const & number = mstruct.number();
+    if (!number.isRational() || number.isApproximate()) {
+        return false;
+    }
+
+    if (number.isInteger()) {
+        if (number.integerLength() <= static_cast<int>(max_digits)) {
+            return false;
+        }
+        out.clear();
+        print_integer(number, po, max_digits, out);
+        return true;
+    }
+
+    // Decimals are cut off at the precision, only a fraction prints every digit
+    Number const numerator = number.numerator();
+    Number const denominator = number.denominator();
+    if (!prints_fractions(po)
+            || numerator.integerLength() + denominator.integerLength() <= static_cast<int>(max_digits)) {
+        return false;
+    }
+    unsigned const part_digits = std::max(1u, max_digits / 2);
+    out.clear();
+    print_integer(numerator, po, part_digits, out);
+    out.append("/");
+    print_integer(denominator, po, part_digits, out);
+    return true;
+}
+
+bool result_display::abbreviate(std::string_view text, unsigned max_length, std::string & out)
+{
+    if (text.length() <= max_length) {
+        return false;
+    }
+
+    // Don't cut a UTF-8 sequence in half
+    size_t cut = max_length;
+    while (cut > 0 && (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) {
+        cut -= 1;
+    }
+
+    auto const unsigned_text = strip_sign(text);
+    bool const is_integer = unsigned_text.find_first_not_of("0123456789") == std::string_view::npos;
+
+    out.assign(text.substr(0, cut)).append(ELLIPSIS).append(" (");
+    if (is_integer) {
+        out.append(std::to_string(unsigned_text.length())).append(" digits)");
+    } else {
+        out.append(std::to_string(text.length())).append(" characters)");
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+/*
+* rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "result_formats.h"
+
+#include <algorithm>
+#include <libqalculate/qalculate.h>
+
+using namespace rq;
+
+/*
+ * Only formats that change how numbers are printed, printing them doesn't touch the
+ * Calculator's state so they can be printed concurrently with the next evaluation.
+ */
+static constexpr ResultFormat result_formats[] = {
+    { "hex", [](PrintOptions & po) { po.base = BASE_HEXADECIMAL; } },
+    { "oct", [](PrintOptions & po) { po.base = BASE_OCTAL; } },
+    { "bin", [](PrintOptions & po) { po.base = BASE_BINARY; } },
+    { "fraction", [](PrintOptions & po) { po.number_fraction_format = FRACTION_FRACTIONAL; } },
+    { "sci", [](PrintOptions & po) { po.min_exp = EXP_SCIENTIFIC; } },
+};
+
+ResultFormat const * rq::find_result_format(std::string_view const & name)
+{
+    auto const it = std::ranges::find(result_formats, name, &ResultFormat::name);
+    return it != std::end(result_formats) ? it : nullptr;
+}
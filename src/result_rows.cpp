@@ -0,0 +1,102 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "result_rows.h"
+#include "alloc_counter.h"
+
+#include <libqalculate/qalculate.h>
+
+using namespace rq;
+
+ResultRows::ResultRows(size_t size)
+    : _size(size)
+    , _chunks((size + CHUNK_SIZE - 1) / CHUNK_SIZE)
+    , _requested(_chunks.size())
+{
+}
+
+ResultRows::~ResultRows() = default;
+
+std::shared_ptr<ResultRows> ResultRows::from_vector(MathStructure const & vector)
+{
+    std::shared_ptr<ResultRows> rows{new ResultRows(vector.size())};
+
+    alloc_counter::ExternalScope const libqalculate;
+    rows->_values = std::make_unique<MathStructure>(vector);
+    return rows;
+}
+
+std::shared_ptr<ResultRows> ResultRows::from_range(MathStructure const & expression, MathStructure const & variable,
+                                                   std::string_view variable_name, long first, size_t count)
+{
+    std::shared_ptr<ResultRows> rows{new ResultRows(count)};
+
+    rows->_variable_name = variable_name;
+    rows->_first = first;
+
+    alloc_counter::ExternalScope const libqalculate;
+    rows->_values = std::make_unique<MathStructure>(expression);
+    rows->_variable = std::make_unique<MathStructure>(variable);
+    return rows;
+}
+
+std::string const * ResultRows::row(size_t index) const
+{
+    std::lock_guard lock(this->_mtx);
+
+    auto const & chunk = this->_chunks[index / CHUNK_SIZE];
+    return chunk != nullptr ? &(*chunk)[index % CHUNK_SIZE] : nullptr;
+}
+
+bool ResultRows::request(size_t index)
+{
+    auto && requested = this->_requested[index / CHUNK_SIZE];
+    if (requested) {
+        return false;
+    }
+    requested = true;
+    return true;
+}
+
+std::string ResultRows::print_row(Calculator & calc, size_t index, int timeout_ms,
+                                  EvaluationOptions const & eo, PrintOptions const & po) const
+{
+    alloc_counter::ExternalScope const libqalculate;
+
+    if (this->_variable == nullptr) {
+        return calc.print((*this->_values)[index], timeout_ms, po);
+    }
+
+    long const value = this->_first + static_cast<long>(index);
+    std::string text = this->_variable_name + " = " + std::to_string(value) + ": ";
+
+    MathStructure mstruct(*this->_values);
+    mstruct.replace(*this->_variable, MathStructure(Number(value, 1)));
+    if (!calc.calculate(&mstruct, timeout_ms, eo)) {
+        return text.append("timed out");
+    }
+    return text.append(calc.print(mstruct, timeout_ms, po));
+}
+
+void ResultRows::publish(size_t chunk, std::vector<std::string> rows)
+{
+    auto published = std::make_unique<std::vector<std::string> const>(std::move(rows));
+
+    std::lock_guard lock(this->_mtx);
+    this->_chunks[chunk] = std::move(published);
+}
@@ -17,9 +17,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include "qalc.h"
+#include "definitions.h"
+#include "exchange_rates.h"
+#include "history_scan.h"
+#include "sandbox.h"
 #include "parsing.h"
+#include "task_scheduler.h"
 
 #include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <gmodule.h>
 #include <libqalculate/qalculate.h>
@@ -42,50 +48,406 @@ static gchar * get_config_history_filename(gchar const * basedir)
     return g_build_filename(basedir, "rofi_calc_history", NULL);
 }
 
-// static inline gchar * get_config_variables_filename(gchar const * basedir)
-// {
-//     return g_build_filename(basedir, "rofi_qalc_variables", NULL);
-// }
+static gchar * get_config_variables_filename(gchar const * basedir)
+{
+    return g_build_filename(basedir, "rofi_qalc_variables", NULL);
+}
+
+static std::string get_config_variables_path()
+{
+    gchar * basedir = get_config_basedir();
+    gchar * variables_file = get_config_variables_filename(basedir);
+    std::string path{variables_file};
+
+    g_free(variables_file);
+    g_free(basedir);
+    return path;
+}
+
+static std::string get_config_history_archive_path()
+{
+    gchar * basedir = get_config_basedir();
+    gchar * archive_dir = g_build_filename(basedir, "rofi_qalc_history_archive", NULL);
+    std::string path{archive_dir};
+
+    g_free(archive_dir);
+    g_free(basedir);
+    return path;
+}
+
+static std::string get_config_result_cache_path()
+{
+    gchar * basedir = get_config_basedir();
+    gchar * cache_file = g_build_filename(basedir, "rofi_qalc_result_cache", NULL);
+    std::string path{cache_file};
+
+    g_free(cache_file);
+    g_free(basedir);
+    return path;
+}
+
+/** Matches search_history() looks for before it stops */
+static constexpr size_t HISTORY_SEARCH_LIMIT = 100;
+/** Shorter text has no trigrams, every archive block would have to be decompressed */
+static constexpr size_t ARCHIVE_SEARCH_MIN_LENGTH = 3;
+/** Pause in typing before the archive is searched */
+static constexpr unsigned ARCHIVE_SEARCH_DELAY_MS = 200;
+
+std::string const * RofiQalc::cached_result()
+{
+    if (!this->_has_cached_result) {
+        return nullptr;
+    }
+    // An approximation or an older result doesn't replace it, the exact result of the same expression does
+    auto const & result = last_result();
+    if (!is_eval_in_progress() && !result.is_approximate && result.expression == this->_cached_expression) {
+        this->_has_cached_result = false;
+        return nullptr;
+    }
+    return &this->_cached_result;
+}
+
+void RofiQalc::_update_result_cache_context()
+{
+    if (auto * cache = this->_thread_data.result_cache.get(); cache != nullptr) {
+        cache->set_context(_result_cache_context());
+    }
+}
+
+uint64_t RofiQalc::_result_cache_context() const
+{
+    // Variables from the variables file, the rates' age, the definitions and whatever changes how results are printed
+    constexpr std::hash<std::string_view> hasher;
+    uint64_t context = 0;
+    auto const mix = [&context](uint64_t value) {
+        context ^= value + 0x9e3779b97f4a7c15 + (context << 6) + (context >> 2);
+    };
+    mix(QALCULATE_MAJOR_VERSION * 10000 + QALCULATE_MINOR_VERSION * 100 + QALCULATE_MICRO_VERSION);
+    for (auto const & [name, value] : this->_variables_file.variables()) {
+        mix(hasher(name));
+        mix(hasher(value));
+    }
+    mix(static_cast<uint64_t>(this->_exchange_rates_stamp));
+    mix(this->options.max_result_digits);
+    // Definitions files, local ones included, and which of them -definitions loads
+    mix(this->_definitions_categories);
+    for (unsigned category = 1; (category & definitions::ALL) != 0; category <<= 1) {
+        auto const stamp = definitions::file_stamp(category);
+        mix(static_cast<uint64_t>(stamp.mtime));
+        mix(static_cast<uint64_t>(stamp.size));
+    }
+    auto const local = definitions::local_stamp();
+    mix(static_cast<uint64_t>(local.mtime));
+    mix(static_cast<uint64_t>(local.size));
+    // Units and the like are printed with their translated names
+    mix(hasher(definitions::message_locale()));
+
+    return context;
+}
+
+std::optional<std::string> RofiQalc::complete_name(std::string_view expression)
+{
+    this->_thread_data.completion_index.fetch();
+    auto const & index = this->_thread_data.completion_index.front();
+
+    // Names don't start with a digit, so "2sq" completes "sq"
+    size_t start = expression.length();
+    while (start > 0 && parsing::is_identifier_char(expression[start - 1])) {
+        start -= 1;
+    }
+    while (start < expression.length() && expression[start] >= '0' && expression[start] <= '9') {
+        start += 1;
+    }
+    auto const prefix = expression.substr(start);
+    if (prefix.empty()) {
+        return std::nullopt;
+    }
+
+    // Most used first, then the shortest
+    std::string_view best;
+    unsigned best_uses = 0;
+    index.for_each_with_prefix(prefix, [this, &best, &best_uses](std::string_view name) {
+        auto const it = this->_name_uses.find(name);
+        unsigned const uses = it != this->_name_uses.end() ? it->second : 0;
+        if (best.empty() || uses > best_uses || (uses == best_uses && name.length() < best.length())) {
+            best = name;
+            best_uses = uses;
+        }
+    });
+    if (best.empty() || best == prefix) {
+        return std::nullopt;
+    }
+
+    g_debug("Completed \"%.*s\" to \"%.*s\"", static_cast<int>(prefix.length()), prefix.data(),
+        static_cast<int>(best.length()), best.data());
+    return std::string{expression.substr(0, start)}.append(best);
+}
+
+void RofiQalc::_count_name_uses(std::string_view expression)
+{
+    parsing::for_each_identifier(expression, [this](std::string_view name) {
+        if (auto const it = this->_name_uses.find(name); it != this->_name_uses.end()) {
+            it->second += 1;
+        } else {
+            this->_name_uses.emplace(name, 1);
+        }
+        return true;
+    });
+}
+
+void RofiQalc::fetch_result_rows()
+{
+    auto const & rows = last_result().rows;
+    if (rows == this->_result_rows) {
+        return;
+    }
+    if (this->_result_rows != nullptr) {
+        auto & command = _next_command();
+        command.type = CommandType::RELEASE_ROWS;
+        command.rows = std::move(this->_result_rows);
+        _push_command();
+    }
+    this->_result_rows = rows;
+}
+
+std::string const * RofiQalc::result_row(size_t index, EvalCallback callback, void * userdata)
+{
+    if (auto const * row = this->_result_rows->row(index); row != nullptr) {
+        return row;
+    }
+
+    if (this->_result_rows->request(index)) {
+        auto & command = _next_command();
+        command.type = CommandType::GENERATE_ROWS;
+        command.rows = this->_result_rows;
+        command.row = index;
+        command.callback = callback;
+        command.userdata = userdata;
+        _push_command();
+    }
+    return nullptr;
+}
 
-void RofiQalc::append_result_to_history(bool persistent)
+void RofiQalc::append_result_to_history(bool persistent, std::string_view alternate_result)
 {
-    if (this->_last_expr.empty() || this->previous_result.empty()) {
+    auto const & shown = last_result();
+    auto const & expression = shown.expression;
+    // An abbreviated result that was never printed in full is added as it is shown, the calculator
+    // thread replaces it with the full result
+    bool const print_in_full = alternate_result.empty() && shown.is_abbreviated && shown.full_result.empty();
+    std::string const result{!alternate_result.empty() ? alternate_result
+        : shown.is_abbreviated && !print_in_full ? shown.full_result : shown.result};
+
+    if (expression.empty() || result.empty()) {
         g_debug("Not appending result to history, no data");
         return;
     }
-    if (this->history.size() == this->options.history_length) {
-        this->history.erase(this->history.begin());
+    // The exact result may still differ, it's only known once refining has finished
+    if (is_refining()) {
+        g_debug("Not appending result to history, it's an approximation being refined");
+        return;
     }
 
     // Check whether the expression is a save (e.g. "a = 20"), those don't have a result
     // as such. libqalculate does return the stored value as the answer, but we don't
     // want to save "a = 20 = 20" to history.
-    bool is_save =
-        expression_contains_save_function(this->_last_expr, default_parse_options, false);
-    if (is_save) {
-        g_debug("Appending variable \"%s\" to history", this->_last_expr.c_str());
-        this->history.emplace_back(this->_last_expr, "", persistent, true);
+    _count_name_uses(expression);
+    if (shown.is_assignment) {
+        g_debug("Appending variable \"%s\" to history", expression.c_str());
+        auto const parts = parsing::parse_variable_parts(expression);
+        if (persistent && !this->options.no_persist_history && parts.has_value()) {
+            this->_variables_file.set(parts->name, parts->value);
+        }
+        this->history.append({expression, "", persistent, true});
+        // The calculator has the new value already, it was assigned while evaluating
+        if (parts.has_value()) {
+            _recompute_history_using(parts->name);
+        }
     } else {
-        g_debug("Appending \"%s\" = \"%s\" to history",
-            this->_last_expr.c_str(), this->previous_result.c_str());
-        this->history.emplace_back(this->_last_expr, this->previous_result, persistent, false);
+        g_debug("Appending \"%s\" = \"%s\" to history", expression.c_str(), result.c_str());
+        auto const & added = _append_history_entry({expression, result, persistent, false});
+        if (print_in_full) {
+            _print_full_result(added);
+        }
+    }
+
+    if (this->history.size() > this->options.history_length) {
+        _evict_oldest_history_entry();
     }
 }
 
-void RofiQalc::_load_history_variable_into_qalculate(std::string const & history_line)
+void RofiQalc::_evict_oldest_history_entry()
 {
-    auto & calc = this->_thread_data.calc;
+    auto const & oldest = *this->history.begin();
+
+    if (this->_history_archive != nullptr && oldest.persistent) {
+        this->_evicted_history.push_back(oldest);
+    }
+    this->history.pop_front();
+}
+
+HistoryEntry const & RofiQalc::_append_history_entry(HistoryEntry entry)
+{
+    auto const & added = this->history.append(std::move(entry));
+    if (this->_history_dependencies != nullptr) {
+        this->_history_dependencies->add(added);
+    }
+    return added;
+}
 
-    auto const parsed_variable_opt = parsing::parse_variable_parts(history_line);
-    if (!parsed_variable_opt.has_value()) {
+void RofiQalc::_print_full_result(HistoryEntry const & entry)
+{
+    auto & shown = this->_thread_data.results.front();
+
+    // Handed over for an earlier entry already, this one gets the same text once it's printed
+    if (shown.unprinted_result == nullptr) {
+        if (shown.full_result_entry != 0 && shown.full_result_entry != entry.id) {
+            this->_full_result_copies.emplace_back(shown.full_result_entry, entry.id);
+        }
+        return;
+    }
+
+    shown.full_result_entry = entry.id;
+    auto & command = _next_command();
+    command.type = CommandType::PRINT_FULL_RESULT;
+    command.entries.assign(1, entry);
+    command.unprinted_result = std::move(shown.unprinted_result);
+    command.callback = this->_eval_callback;
+    command.userdata = this->_eval_userdata;
+    this->_thread_data.full_results_pending += 1;
+    _push_command();
+}
+
+void RofiQalc::_recompute_history_using(std::string_view name)
+{
+    if (this->_history_dependencies == nullptr) {
         return;
     }
-    auto const &[name, value] = parsed_variable_opt.value();
 
-    g_info("Found save \"%s\" = \"%s\", adding to qalculate variables", name.c_str(), value.c_str());
+    std::vector<HistoryEntry> entries;
+    if (!this->_history_dependencies->collect(name, this->history, entries)) {
+        return;
+    }
+    g_debug("Recomputing %zu history entries using \"%.*s\"",
+        entries.size(), static_cast<int>(name.length()), name.data());
+
+    auto & command = _next_command();
+    command.type = CommandType::RECOMPUTE_HISTORY;
+    command.entries = std::move(entries);
+    command.callback = this->_eval_callback;
+    command.userdata = this->_eval_userdata;
+    _push_command();
+}
+
+bool RofiQalc::fetch_recomputed_history()
+{
+    {
+        std::lock_guard lock(this->_thread_data.mtx_recomputed_history);
+        if (this->_thread_data.recomputed_history.empty() && this->_thread_data.full_results.empty()) {
+            return false;
+        }
+        this->_recomputed_history.swap(this->_thread_data.recomputed_history);
+        this->_full_results.swap(this->_thread_data.full_results);
+    }
+
+    bool changed = false;
+    for (auto & entry : this->_recomputed_history) {
+        // Entries removed in the meantime are gone from history as well
+        changed |= this->history.set_result(entry.id, std::move(entry.result));
+    }
+    this->_recomputed_history.clear();
 
-    auto * history_variable = new KnownVariable(calc->temporaryCategory(), name, value);
-    calc->addVariable(history_variable);
+    auto & shown = this->_thread_data.results.front();
+    for (auto & entry : this->_full_results) {
+        // Adding the same result again takes the text from the slot from now on
+        if (shown.full_result_entry == entry.id) {
+            shown.full_result = entry.result;
+        }
+        std::erase_if(this->_full_result_copies, [this, &entry, &changed](auto const & copy) {
+            if (copy.first != entry.id) {
+                return false;
+            }
+            changed |= this->history.set_result(copy.second, entry.result);
+            return true;
+        });
+        changed |= this->history.set_result(entry.id, std::move(entry.result));
+    }
+    this->_full_results.clear();
+    return changed;
+}
+
+void RofiQalc::search_history(std::string_view text, EvalCallback callback, void * userdata)
+{
+    auto const matches = [text](HistoryEntry const & entry) {
+        return entry.expression.find(text) != std::string::npos || entry.result.find(text) != std::string::npos;
+    };
+
+    this->_is_searching_history = true;
+    this->_history_matches.clear();
+
+    auto const search = [this, &matches](auto first, auto last) {
+        for (auto it = first; it != last && this->_history_matches.size() < HISTORY_SEARCH_LIMIT; ++it) {
+            if (matches(*it)) {
+                this->_history_matches.push_back(*it);
+            }
+        }
+    };
+    search(std::make_reverse_iterator(this->history.end()), std::make_reverse_iterator(this->history.begin()));
+    // Not archived yet, but older than anything in history
+    search(this->_evicted_history.rbegin(), this->_evicted_history.rend());
+
+    g_debug("History search for \"%.*s\" found %zu entries",
+        static_cast<int>(text.length()), text.data(), this->_history_matches.size());
+
+    // Typing restarts the pause, reading the archive for every keystroke would block rofi
+    if (this->_archive_search_timer != 0) {
+        g_source_remove(this->_archive_search_timer);
+        this->_archive_search_timer = 0;
+    }
+    if (this->_history_archive != nullptr && text.length() >= ARCHIVE_SEARCH_MIN_LENGTH
+            && this->_history_matches.size() < HISTORY_SEARCH_LIMIT) {
+        this->_archive_search_text.assign(text);
+        this->_archive_search_callback = callback;
+        this->_archive_search_userdata = userdata;
+        this->_archive_search_timer = g_timeout_add(ARCHIVE_SEARCH_DELAY_MS, _archive_search_cb, this);
+    }
+}
+
+void RofiQalc::end_history_search()
+{
+    this->_is_searching_history = false;
+    if (this->_archive_search_timer != 0) {
+        g_source_remove(this->_archive_search_timer);
+        this->_archive_search_timer = 0;
+    }
+}
+
+int RofiQalc::_archive_search_cb(void * userdata)
+{
+    auto * state = static_cast<RofiQalc*>(userdata);
+    auto const & text = state->_archive_search_text;
+
+    state->_archive_search_timer = 0;
+    size_t const found = state->_history_matches.size();
+    state->_history_archive->search(text, HISTORY_SEARCH_LIMIT, state->_history_matches);
+    g_debug("Archive search for \"%s\" found %zu entries", text.c_str(), state->_history_matches.size() - found);
+
+    if (state->_history_matches.size() != found) {
+        state->_archive_search_callback(state->_archive_search_userdata);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void RofiQalc::_load_variables_into_qalculate(std::vector<VariableDefinition> const & variables)
+{
+    if (variables.empty()) {
+        return;
+    }
+
+    auto & command = _next_command();
+    command.type = CommandType::ADD_VARIABLES;
+    command.variables.assign(variables.begin(), variables.end());
+    _push_command();
 }
 
 void RofiQalc::load_history()
@@ -99,8 +461,21 @@ void RofiQalc::load_history()
     g_debug("Loading history from %s", history_file);
 
     this->history.clear();
+    this->_evicted_history.clear();
+    this->_name_uses.clear();
+    if (this->_history_dependencies != nullptr) {
+        this->_history_dependencies->clear();
+    }
 
     g_mkdir_with_parents(history_dir, 0755);
+    this->_thread_data.memory_report.restart();
+
+    // Without a snapshot the variables are restored from history once more, creating the snapshot
+    bool const has_variables_file = this->_variables_file.load();
+    this->_thread_data.memory_report.mark("variables file");
+    bool const create_variables_file = !has_variables_file && !this->options.no_persist_history;
+    std::vector<VariableDefinition> history_variables;
+
     if (g_file_test(history_file, static_cast<GFileTest>(G_FILE_TEST_EXISTS | G_FILE_TEST_IS_REGULAR))) {
         g_file_get_contents(history_file, &history_data, &history_size, &error);
         if (error != nullptr) {
@@ -109,25 +484,27 @@ void RofiQalc::load_history()
 
         g_debug("History file is %lu b", history_size);
 
-        gchar * head = history_data;
-        while (head < history_data + history_size) {
-            auto * newline = static_cast<gchar*>(memchr(head, '\n', history_size - (head - history_data)));
-            if (newline == nullptr) {
-                newline = history_data + history_size;
-            }
-            // g_debug("history line %lu (%lu) %.*s",
-            //         state->history_used, newline - head, (int)(newline - head), head);
+        // Lines the scanner rules out as assignments skip libqalculate's much slower check
+        HistoryScanner scanner{{history_data, history_size}, this->_save_keywords};
+        HistoryLine history_line;
+        while (scanner.next(history_line)) {
+            std::string line{history_line.text};
 
-            std::string line{head, static_cast<size_t>(newline - head)};
-
-            bool is_save =
-                expression_contains_save_function(std::string{line}, default_parse_options, false);
+            bool is_save = history_line.maybe_assignment
+                && expression_contains_save_function(line, default_parse_options, false);
             if (is_save) {
                 g_debug("Loading history variable \"%s\"", line.c_str());
-                this->history.emplace_back(line, "", true, true);
-
-                if (!options.no_load_history_variables) {
-                    _load_history_variable_into_qalculate(line);
+                _count_name_uses(line);
+                this->history.append({line, "", true, true});
+
+                auto const parts = parsing::parse_variable_parts(line);
+                if (!has_variables_file && parts.has_value()) {
+                    if (!this->options.no_load_history_variables) {
+                        history_variables.emplace_back(std::string{parts->name}, std::string{parts->value});
+                    }
+                    if (create_variables_file) {
+                        this->_variables_file.set(parts->name, parts->value);
+                    }
                 }
             } else {
                 std::string expression;
@@ -135,7 +512,7 @@ void RofiQalc::load_history()
 
                 g_debug("Loading history expression \"%s\"", line.c_str());
 
-                auto separator_pos = line.rfind(HistoryEntry::separator);
+                auto const separator_pos = history_line.separator;
                 if (separator_pos != std::string::npos) {
                     expression = line.substr(0, separator_pos);
                     result = line.substr(separator_pos + HistoryEntry::separator.length());
@@ -143,29 +520,56 @@ void RofiQalc::load_history()
                     expression = "";
                     result = line;
                 }
-                this->history.emplace_back(expression, result, true, false);
+                _count_name_uses(expression);
+                _append_history_entry({std::move(expression), std::move(result), true, false});
             }
 
-            if (this->history.size() == this->options.history_length) {
+            if (this->history.size() > this->options.history_length) {
+                // The newest entries stay, the rest are archived by save_history()
+                _evict_oldest_history_entry();
+            } else if (this->history.size() == this->options.history_length && this->_history_archive == nullptr) {
                 g_warning("History file reading stopped, file longer than history_length");
                 break;
             }
-
-            head = newline + 1;
         }
     }
 
+    this->_thread_data.memory_report.mark("history file");
+    _update_result_cache_context();
+
+    if (!this->options.no_load_history_variables) {
+        _load_variables_into_qalculate(has_variables_file ? this->_variables_file.variables() : history_variables);
+    }
+
     g_free(history_data);
     g_free(history_file);
     g_free(history_dir);
 }
 
-void RofiQalc::save_history() const
+void RofiQalc::save_history()
 {
+    // Results still being printed in full go into the file complete
+    for (unsigned pending; (pending = this->_thread_data.full_results_pending.load()) != 0;) {
+        if (_flush_commands()) {
+            this->_thread_data.full_results_pending.wait(pending);
+        } else {
+            // The main loop doesn't run anymore, so nothing else hands the commands over
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    fetch_recomputed_history();
+
     GError * error = nullptr;
     gchar * history_dir = get_config_basedir();
     gchar * history_file = get_config_history_filename(history_dir);
 
+    // Archived first, if writing the history file fails they're in both rather than in neither
+    if (this->_history_archive != nullptr && !this->_evicted_history.empty()) {
+        if (this->_history_archive->append(this->_evicted_history)) {
+            this->_evicted_history.clear();
+        }
+    }
+
     auto accumulator = [](size_t const acc, HistoryEntry const & e) {
         if (!e.persistent) {
             return acc;
@@ -197,6 +601,64 @@ void RofiQalc::save_history() const
     g_free(history_dir);
 }
 
+/** Estimated heap bytes of history entries held in a vector */
+static size_t entries_memory_usage(std::vector<HistoryEntry> const & entries)
+{
+    size_t bytes = entries.capacity() * sizeof(HistoryEntry);
+    for (auto const & entry : entries) {
+        bytes += MemoryReport::string_bytes(entry.expression) + MemoryReport::string_bytes(entry.result);
+    }
+    return bytes;
+}
+
+void RofiQalc::log_memory_report()
+{
+    auto const & memory_report = this->_thread_data.memory_report;
+    if (!memory_report.enabled()) {
+        return;
+    }
+
+    // Only what the main thread holds, the calculator thread's slots and libqalculate's structures
+    // show up in the phases
+    auto const & result = last_result();
+    size_t result_bytes = MemoryReport::string_bytes(result.expression) + MemoryReport::string_bytes(result.result)
+        + MemoryReport::string_bytes(result.full_result);
+    for (auto const & message : result.messages) {
+        result_bytes += sizeof(message) + MemoryReport::string_bytes(message.message);
+    }
+
+    size_t alternate_bytes = 0;
+    for (auto const & alternate : alternate_results()) {
+        alternate_bytes += sizeof(alternate) + MemoryReport::string_bytes(alternate.text);
+    }
+
+    // A node per name, with the next pointer and cached hash, plus the bucket array
+    size_t name_uses_bytes = this->_name_uses.bucket_count() * sizeof(void *);
+    for (auto const & [name, _] : this->_name_uses) {
+        name_uses_bytes += sizeof(decltype(this->_name_uses)::value_type) + 2 * sizeof(void *)
+            + MemoryReport::string_bytes(name);
+    }
+
+    size_t variables_bytes = 0;
+    for (auto const & [name, value] : this->_variables_file.variables()) {
+        variables_bytes += sizeof(VariableDefinition) + MemoryReport::string_bytes(name) + MemoryReport::string_bytes(value);
+    }
+
+    MemoryReport::Estimate const estimates[] = {
+        { "history", this->history.memory_usage() },
+        { "history to archive", entries_memory_usage(this->_evicted_history) },
+        { "history search", entries_memory_usage(this->_history_matches) },
+        { "history dependencies",
+            this->_history_dependencies != nullptr ? this->_history_dependencies->memory_usage() : 0 },
+        { "result", result_bytes },
+        { "alternate results", alternate_bytes },
+        { "name uses", name_uses_bytes },
+        { "completion index", this->_thread_data.completion_index.front().memory_usage() },
+        { "variables", variables_bytes },
+    };
+    memory_report.log(estimates);
+}
+
 void RofiQalc::erase_history_line(int index)
 {
     auto const & entry = this->history[index];
@@ -205,64 +667,228 @@ void RofiQalc::erase_history_line(int index)
         index, entry.expression.c_str(), entry.is_assignment);
 
     if (entry.is_assignment) {
-        auto & calc = this->_thread_data.calc;
-
         auto const variable_parts_opt = parsing::parse_variable_parts(entry.expression);
         if (!variable_parts_opt.has_value()) {
             throw std::runtime_error("Failed to parse variable parts");
         }
         auto const &[var_name, _] = variable_parts_opt.value();
 
-        auto comparator = [&var_name](Variable const * var) {
-            return var->name() == var_name;
-        };
-        auto const it = std::ranges::find_if(calc->variables, comparator);
-        if (it != std::end(calc->variables)) {
-            g_debug("Found created variable from expr \"%s\", removing it as well", (*it)->title().c_str());
-            calc->expressionItemDeleted(*it);
+        bool const is_in_variables_file = entry.persistent && !this->options.no_persist_history;
+        if (is_in_variables_file) {
+            this->_variables_file.remove(var_name);
         }
+
+        // The variable created by the expression goes as well
+        auto & command = _next_command();
+        command.type = CommandType::DELETE_VARIABLE;
+        command.name.assign(var_name);
+        // Results cached with the variable can't be told apart otherwise
+        command.result_cache_context = is_in_variables_file
+            ? std::optional<uint64_t>{_result_cache_context()} : std::nullopt;
+        _push_command();
+        _recompute_history_using(var_name);
     }
 
-    this->history.erase(this->history.begin() + index);
+    this->history.erase(index);
 }
 
 RofiQalc::RofiQalc()
-    : _var_ans{}
+    : _variables_file(get_config_variables_path())
 {
     auto & calc = this->_thread_data.calc;
+    auto & memory_report = this->_thread_data.memory_report;
+
+    memory_report.mark("calculator");
 
-    if (!calc->loadExchangeRates()) {
-        g_warning("Failed to load exchange rates");
+    if (this->options.history_archive) {
+        this->_history_archive = std::make_unique<HistoryArchive>(get_config_history_archive_path());
     }
-    if (!calc->loadGlobalDefinitions()) {
-        g_warning("Failed to load global definitions");
+    if (this->options.recompute_history) {
+        this->_history_dependencies = std::make_unique<HistoryDependencies>();
     }
+
+    // Looked up before the result cache is set up, they are part of its context
+    unsigned categories = this->options.definitions.empty() ? definitions::ALL : 0u;
+    for (auto const & name : this->options.definitions) {
+        unsigned const category = definitions::find_category(name);
+        if (category == 0) {
+            g_warning("Unknown definitions category \"%s\"", name.c_str());
+        }
+        categories |= category;
+    }
+    this->_definitions_categories = categories;
+
+    if (this->options.result_cache > 0) {
+        this->_thread_data.result_cache = std::make_unique<ResultCache>(
+            get_config_result_cache_path(), this->options.result_cache);
+        this->_exchange_rates_stamp = exchange_rates::source_stamp(*calc);
+        // Set again once the variables file has been loaded
+        _update_result_cache_context();
+    }
+
+    // Exchange rates are loaded by the calculator thread, once they're needed
+    auto & definitions_index = this->_thread_data.definitions_index;
+    definitions_index.read();
+    this->_thread_data.definitions_loaded = definitions::load(*calc, categories, 0, &definitions_index);
     if (!calc->loadLocalDefinitions()) {
         g_warning("Failed to load local definitions");
     }
+    memory_report.mark("definitions");
 
     // Set up ans variables
+    auto & var_ans = this->_thread_data.var_ans;
     std::string const ans_str = "ans";
-    for (size_t i = 0; i < std::size(this->_var_ans); ++i) {
+    for (size_t i = 0; i < std::size(var_ans); ++i) {
         auto index_str = std::to_string(i + 1);
         auto * kv = new KnownVariable(
             calc->temporaryCategory(), ans_str + index_str, m_undefined,
             "Answer " + index_str, false, true);
-        this->_var_ans[i] = dynamic_cast<KnownVariable*>(calc->addVariable(kv));
+        var_ans[i] = dynamic_cast<KnownVariable*>(calc->addVariable(kv));
     }
     // Add aliases for answer variable
-	this->_var_ans[0]->addName("answer");
-	this->_var_ans[0]->addName(ans_str);
+	var_ans[0]->addName("answer");
+	var_ans[0]->addName(ans_str);
+    memory_report.mark("ans variables");
+
+    // The calculator belongs to its thread once that's running, so these are looked up now
+    if (auto const * save_function = calc->f_save; save_function != nullptr) {
+        for (size_t i = 1; i <= save_function->countNames(); ++i) {
+            this->_save_keywords.push_back(save_function->getName(i).name);
+        }
+    }
+
+    // Forked before the calculator thread starts, so the sandbox gets a calculator at rest.
+    // ThreadData doesn't start threads of its own, this is the only thread using the calculator so far.
+    if (this->options.sandbox_eval) {
+        this->_thread_data.sandbox = std::make_unique<Sandbox>(
+            *calc, _result_print_options(), this->_thread_data.definitions_loaded,
+            this->_thread_data.definitions_index, this->options.sandbox_memory_mb);
+        memory_report.mark("sandbox");
+    }
 
-    this->_thread = std::thread{_calculator_thread_entry, std::ref(this->_thread_data)};
 }
 
 RofiQalc::~RofiQalc()
 {
-    this->_thread_data.should_quit = true;
+    if (this->_exchange_rates_timer != 0) {
+        g_source_remove(this->_exchange_rates_timer);
+    }
+    if (this->_flush_commands_timer != 0) {
+        g_source_remove(this->_flush_commands_timer);
+    }
+    if (this->_archive_search_timer != 0) {
+        g_source_remove(this->_archive_search_timer);
+    }
+
+    if (this->_thread.joinable()) {
+        this->_thread_data.should_quit = true;
+        _notify_calculator_thread();
+        this->_thread.join();
+    }
+}
+
+void RofiQalc::start()
+{
+    this->_thread = std::thread{_calculator_thread_entry, std::ref(this->_thread_data)};
+
+    if (this->options.exchange_rates_idle_ms > 0) {
+        _arm_exchange_rates_timer();
+    }
+}
+
+CalculatorCommand & RofiQalc::_next_command()
+{
+    // Commands that didn't fit go first, they're older
+    if (_flush_commands()) {
+        if (auto * command = this->_thread_data.commands.back(); command != nullptr) {
+            this->_is_next_command_overflow = false;
+            return *command;
+        }
+    }
+    this->_is_next_command_overflow = true;
+    return this->_overflow_commands.emplace_back();
+}
+
+void RofiQalc::_push_command()
+{
+    if (!this->_is_next_command_overflow) {
+        this->_thread_data.commands.push();
+        _notify_calculator_thread();
+        return;
+    }
+
+    // Only happens when commands pile up behind a long evaluation. The newest evaluation is the
+    // only one that would be done, the older ones are dropped
+    auto & overflow = this->_overflow_commands;
+    if (overflow.back().type == CommandType::EVALUATE) {
+        std::erase_if(overflow, [&overflow](CalculatorCommand const & command) {
+            return command.type == CommandType::EVALUATE && &command != &overflow.back();
+        });
+    }
+    g_debug("Command queue is full, %zu commands wait for the calculator thread", overflow.size());
+    if (this->_flush_commands_timer == 0) {
+        this->_flush_commands_timer = g_timeout_add(1, _flush_commands_cb, this);
+    }
+    _notify_calculator_thread();
+}
+
+bool RofiQalc::_flush_commands()
+{
+    auto & overflow = this->_overflow_commands;
+    bool const had_overflow = !overflow.empty();
+
+    while (!overflow.empty()) {
+        auto * command = this->_thread_data.commands.back();
+        if (command == nullptr) {
+            break;
+        }
+        *command = std::move(overflow.front());
+        overflow.pop_front();
+        this->_thread_data.commands.push();
+    }
+    if (had_overflow) {
+        _notify_calculator_thread();
+    }
+    return overflow.empty();
+}
+
+int RofiQalc::_flush_commands_cb(void * userdata)
+{
+    auto * state = static_cast<RofiQalc*>(userdata);
+
+    if (!state->_flush_commands()) {
+        return G_SOURCE_CONTINUE;
+    }
+    state->_flush_commands_timer = 0;
+    return G_SOURCE_REMOVE;
+}
+
+void RofiQalc::_notify_calculator_thread()
+{
     this->_thread_data.has_new_data = true;
     this->_thread_data.has_new_data.notify_one();
-    this->_thread.join();
+}
+
+int RofiQalc::_exchange_rates_idle_cb(void * userdata)
+{
+    auto * state = static_cast<RofiQalc*>(userdata);
+
+    g_debug("Idle for %u ms, requesting exchange rates", state->options.exchange_rates_idle_ms);
+
+    state->_exchange_rates_timer = 0;
+    state->_next_command().type = CommandType::LOAD_EXCHANGE_RATES;
+    state->_push_command();
+
+    return G_SOURCE_REMOVE;
+}
+
+void RofiQalc::_arm_exchange_rates_timer()
+{
+    if (this->_exchange_rates_timer != 0) {
+        g_source_remove(this->_exchange_rates_timer);
+    }
+    this->_exchange_rates_timer =
+        g_timeout_add(this->options.exchange_rates_idle_ms, _exchange_rates_idle_cb, this);
 }
 
 void RofiQalc::evaluate(std::string_view const & expr, EvalCallback callback, void * userdata)
@@ -274,36 +900,35 @@ void RofiQalc::evaluate(std::string_view const & expr, EvalCallback callback, vo
         return;
     }
     this->_last_expr_hash = hash;
-    this->_last_expr = expr;
+    this->_last_expression.assign(expr);
+    this->_eval_callback = callback;
+    this->_eval_userdata = userdata;
+
+    // Shown while the calculator thread gets to the expression, see cached_result()
+    if (auto * cache = this->_thread_data.result_cache.get(); cache != nullptr) {
+        this->_cached_expression.assign(expr);
+        this->_has_cached_result = cache->lookup(expr, this->_cached_result);
+    }
 
-    {
-        std::lock_guard lock(this->_thread_data.mtx_queued_query);
-        this->_thread_data.queued_query.expression = expr;
-        this->_thread_data.queued_query.callback = callback;
-        this->_thread_data.queued_query.userdata = userdata;
+    auto & command = _next_command();
+    command.type = CommandType::EVALUATE;
+    command.expression = expr;
+    command.callback = callback;
+    command.userdata = userdata;
+    _push_command();
+    // A background step at SCHED_IDLE would hold the evaluation back until the CPU is idle
+    if (this->options.background_sched_idle) {
+        TaskScheduler::raise_from_idle(this->_thread);
+    }
+
+    // Typing restarts the idle period
+    if (this->_exchange_rates_timer != 0) {
+        _arm_exchange_rates_timer();
     }
-    this->_thread_data.has_new_data = true;
-    this->_thread_data.has_new_data.notify_one();
 }
 
 void RofiQalc::update_ans()
 {
-    MathStructure m4(this->_var_ans[3]->get());
-    m4.replace(this->_var_ans[4], this->_var_ans[4]->get());
-    this->_var_ans[4]->set(m4);
-
-    MathStructure m3(this->_var_ans[2]->get());
-    m3.replace(this->_var_ans[3], this->_var_ans[4]);
-    this->_var_ans[3]->set(m3);
-
-    MathStructure m2(this->_var_ans[1]->get());
-    m2.replace(this->_var_ans[2], this->_var_ans[3]);
-    this->_var_ans[2]->set(m2);
-
-    MathStructure m1(this->_var_ans[0]->get());
-    m1.replace(this->_var_ans[1], this->_var_ans[2]);
-    this->_var_ans[1]->set(m1);
-
-    this->_thread_data.last_result->replace(this->_var_ans[0], this->_var_ans[1]);
-    this->_var_ans[0]->set(*this->_thread_data.last_result);
+    _next_command().type = CommandType::ROTATE_ANS;
+    _push_command();
 }
@@ -17,7 +17,17 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include "qalc.h"
+#include "alloc_counter.h"
+#include "definitions.h"
+#include "exchange_rates.h"
+#include "expression_cache.h"
+#include "native_eval.h"
+#include "parsing.h"
+#include "result_display.h"
+#include "task_scheduler.h"
 
+#include <algorithm>
+#include <format>
 #include <gmodule.h>
 #include <libqalculate/qalculate.h>
 
@@ -27,150 +37,1052 @@
 using namespace rq;
 
 ThreadData::ThreadData(Options const & options)
-    : calc(std::make_unique<Calculator>())
+    : memory_report(options.memory_report)
+    , calc(std::make_unique<Calculator>())
     , last_result(std::make_unique<MathStructure>())
+    , base_result(std::make_unique<MathStructure>())
     , options(options)
     , has_new_data(false)
-    , queued_query({})
 {
+    for (auto const & name : options.result_formats) {
+        auto const * format = find_result_format(name);
+        if (format == nullptr) {
+            g_warning("Unknown result format \"%s\"", name.c_str());
+            continue;
+        }
+        this->result_formats.push_back(format);
+    }
 }
 
-static constexpr bool starts_with(char const * const haystack, std::string const & needle)
+static void clear_alternate_results(ThreadData & data)
 {
-    bool gobble_whitespace = true;
-    char const * ptr = haystack;
-    std::string::size_type pos = 0;
-    while (*ptr != 0) {
-        if (std::isspace(*ptr) && gobble_whitespace) {
-            ptr += 1;
-            continue;
-        }
-        gobble_whitespace = false;
+    data.alternate_results.back().rows.clear();
+    data.alternate_results.publish();
+}
+
+static void load_exchange_rates(ThreadData & data)
+{
+    if (data.exchange_rates_loaded) {
+        return;
+    }
+    // Only attempt once, failing to load the rate files won't get better by retrying
+    data.exchange_rates_loaded = true;
+
+    data.definitions_loaded = definitions::load(
+        *data.calc, definitions::CURRENCIES, data.definitions_loaded, &data.definitions_index);
+
+    auto const before = data.memory_report.enabled() ? MemoryReport::usage() : MemoryReport::Usage{};
+    if (!exchange_rates::load(*data.calc)) {
+        g_warning("Failed to load exchange rates");
+    }
+    data.memory_report.add("exchange rates", before);
+    // Currencies created by loading the rates change how names are parsed
+    data.definitions_generation += 1;
+}
+
+/**
+ * Loads exchange rates ahead of time, in two steps so an evaluation coming in can go in between.
+ * The currency definitions and the rate files are the slow parts.
+ */
+static Task load_exchange_rates_task(ThreadData & data, TaskScheduler & scheduler)
+{
+    if (data.exchange_rates_loaded) {
+        co_return;
+    }
+
+    unsigned const loaded = definitions::load(
+        *data.calc, definitions::CURRENCIES, data.definitions_loaded, &data.definitions_index);
+    if (loaded != data.definitions_loaded) {
+        data.definitions_loaded = loaded;
+        data.definitions_generation += 1;
+    }
+
+    co_await scheduler.yield();
+    // Does nothing if an evaluation needed the rates in the meantime
+    load_exchange_rates(data);
+}
+
+/** Time the sandbox worker gets on top of Options::eval_timeout_ms before it's killed */
+static constexpr int SANDBOX_GRACE_MS = 500;
+
+/**
+ * Evaluates the expression in the sandbox worker.
+ * @param ms Receives the result, parsed back from text
+ * @return Whether there's a result
+ */
+static bool evaluate_in_sandbox(ThreadData & data, std::string const & expression, bool print_parsed,
+                                int timeout_ms, EvalResult & eval_result, MathStructure & ms)
+{
+    auto & reply = data.sandbox_reply;
+    int const kill_after_ms = data.options.eval_timeout_ms + SANDBOX_GRACE_MS;
 
-        if (std::tolower(*ptr) != std::tolower(needle.c_str()[pos])) {
+    switch (data.sandbox->evaluate(*data.calc, expression, print_parsed, timeout_ms, kill_after_ms, reply)) {
+        case SandboxStatus::OK:
+            break;
+        case SandboxStatus::KILLED:
+            eval_result.messages.add(ERROR, "Evaluation was stopped after {} ms", kill_after_ms);
             return false;
-        }
+        case SandboxStatus::CRASHED:
+            eval_result.messages.add(ERROR, "Evaluation was stopped, it ran out of memory or CPU time");
+            return false;
+        case SandboxStatus::FAILED:
+            eval_result.messages.add(ERROR, "Evaluation process is not available");
+            return false;
+    }
 
-        pos += 1;
-        ptr += 1;
+    for (auto const & message : reply.messages) {
+        eval_result.messages.add(message.type, "{}", message.message);
+    }
+    if (reply.timed_out) {
+        g_info("Timed out after %d ms!", timeout_ms);
+        eval_result.messages.add(ERROR, "Evaluation timed out after {} ms", timeout_ms);
+        return false;
+    }
+    // Swapping keeps both buffers around
+    eval_result.result.swap(reply.result);
 
-        if (pos == needle.length()) {
-            return true;
-        }
+    // The structure itself stays in the worker, it's needed here for ans and alternate formats
+    alloc_counter::ExternalScope const libqalculate;
+    data.calc->calculate(&ms, reply.parsable_result, timeout_ms, default_evaluation_options);
+    data.calc->clearMessages();
+    return true;
+}
+
+/** Precision used for the first, approximate phase of progressive evaluation */
+static constexpr int PROGRESSIVE_PRECISION = 8;
+
+/**
+ * First phase of progressive evaluation, evaluates the expression with reduced precision and
+ * approximation enabled.
+ * @param approximation Receives the evaluated approximation
+ * @param approximate_result Receives the printed approximation
+ * @return Whether the approximation finished within timeout_ms
+ */
+static bool evaluate_approximation(Calculator & calc, ParsedExpression const & parsed,
+                                   EvaluationOptions const & eo, PrintOptions const & po,
+                                   int timeout_ms, MathStructure & approximation,
+                                   std::string & approximate_result)
+{
+    alloc_counter::ExternalScope const libqalculate;
+    EvaluationOptions approximate_eo = eo;
+    approximate_eo.approximation = APPROXIMATION_APPROXIMATE;
+
+    int const precision = calc.getPrecision();
+    calc.setPrecision(PROGRESSIVE_PRECISION);
+
+    approximation.set(*parsed.parsed);
+    bool const finished = calc.calculate(&approximation, timeout_ms, approximate_eo, parsed.conversion);
+    if (finished) {
+        approximate_result = calc.print(approximation, timeout_ms, po);
     }
 
-    return false;
+    calc.setPrecision(precision);
+    // Whatever the approximation had to say is repeated by the exact evaluation
+    calc.clearMessages();
+
+    g_debug("Approximation %s", finished ? approximate_result.c_str() : "timed out");
+    return finished;
+}
+
+/** Result slot to fill in, with every member cleared. Both slots are recycled */
+static EvalResult & next_result(ThreadData & data)
+{
+    EvalResult & eval_result = data.results.back();
+
+    eval_result.result.clear();
+    eval_result.messages.clear();
+    eval_result.is_approximate = false;
+    eval_result.is_assignment = false;
+    eval_result.is_abbreviated = false;
+    eval_result.full_result.clear();
+    eval_result.full_result_entry = 0;
+    eval_result.rows.reset();
+    eval_result.plot.reset();
+
+    return eval_result;
+}
+
+/** Publishes an approximate result, to be replaced by the exact one later */
+static void publish_approximation(ThreadData & data, CalculatorCommand const & query,
+                                  std::string const & approximate_result)
+{
+    EvalResult & preview = next_result(data);
+    preview.expression = query.expression;
+    preview.result = approximate_result;
+    preview.is_approximate = true;
+    data.results.publish();
+
+    query.callback(query.userdata);
+}
+
+/** Abbreviates a result that was printed in full already, if it's too long */
+static void abbreviate_printed_result(Options const & options, EvalResult & eval_result)
+{
+    if (options.max_result_digits == 0) {
+        return;
+    }
+    // The abbreviation goes into full_result, swapping puts both where they belong
+    if (result_display::abbreviate(eval_result.result, options.max_result_digits, eval_result.full_result)) {
+        eval_result.result.swap(eval_result.full_result);
+        eval_result.is_abbreviated = true;
+    }
 }
 
 /**
- * Calculator thread entrypoint.
- * A separate thread is used call libqalculate since some expressions can take a while to
- * evaluate (and block the main thread). As the main thread is shared with rofi, then that also
- * blocks the entire rofi window.
- * @param data Thread data
+ * Prints the evaluated result. Huge integers and fractions only get their leading digits printed,
+ * printing all of them can take longer than evaluating them did.
  */
-void RofiQalc::_calculator_thread_entry(ThreadData & data)
+static void print_result(Calculator & calc, Options const & options, MathStructure const & ms,
+                         int timeout_ms, PrintOptions const & po, EvalResult & eval_result)
+{
+    // Printed in full by print_full_result(), if it's ever added to history
+    auto const keep_unprinted = [&ms, &eval_result] {
+        if (eval_result.unprinted_result == nullptr) {
+            eval_result.unprinted_result = std::make_unique<MathStructure>();
+        }
+        eval_result.unprinted_result->set(ms);
+        eval_result.is_abbreviated = true;
+    };
+
+    if (ms.isVector() && ms.size() > 1) {
+        eval_result.rows = ResultRows::from_vector(ms);
+        // The rows show the elements, so long vectors are only summed up
+        if (ms.size() > ResultRows::CHUNK_SIZE) {
+            eval_result.result = ms.isMatrix()
+                ? std::format("[{}×{} matrix]", ms.rows(), ms.columns())
+                : std::format("[{} elements]", ms.size());
+            keep_unprinted();
+            return;
+        }
+    }
+
+    if (options.max_result_digits > 0 && result_display::print_abbreviated_number(
+            ms, po, options.max_result_digits, eval_result.result)) {
+        keep_unprinted();
+        return;
+    }
+
+    eval_result.result = calc.print(ms, timeout_ms, po);
+    abbreviate_printed_result(options, eval_result);
+}
+
+PrintOptions RofiQalc::_result_print_options()
 {
-    auto & calc = data.calc;
-    EvaluationOptions const & eo = default_evaluation_options;
     PrintOptions po = default_print_options;
-    std::vector<LogMessage> log_messages;
 
     po.use_unicode_signs = true;
     po.interval_display = INTERVAL_DISPLAY_SIGNIFICANT_DIGITS;
 
-    bool btrue = true;
-    bool bfalse = false;
+    return po;
+}
 
-    for (;;) {
-        data.has_new_data.wait(false);
-        data.has_new_data.compare_exchange_weak(btrue, bfalse);
+static void add_variables(ThreadData & data, std::vector<VariableDefinition> const & variables)
+{
+    auto & calc = *data.calc;
 
-        ExpressionQuery query;
-        MathStructure ms;
-        std::string result;
-        std::string unlocalized_expr;
-        bool is_plot_query;
-        /* Divided by 2 due to the hack, read below */
-        int eval_timeout_ms = data.options.eval_timeout_ms / 2;
+    for (auto const & [name, value] : variables) {
+        g_info("Adding \"%s\" = \"%s\" to qalculate variables", name.c_str(), value.c_str());
+        calc.addVariable(new KnownVariable(calc.temporaryCategory(), name, value));
+    }
+    data.definitions_generation += 1;
+}
 
-        if (data.should_quit.load()) {
-            break;
+/**
+ * Removes a variable, then moves the result cache to the context without it.
+ * Done here, results stored before are evaluated with the variable still there.
+ */
+static void delete_variable(ThreadData & data, std::string const & name,
+                            std::optional<uint64_t> result_cache_context)
+{
+    auto & calc = *data.calc;
+
+    auto const it = std::ranges::find_if(calc.variables, [&name](Variable const * var) {
+        return var->name() == name;
+    });
+    if (it != std::end(calc.variables)) {
+        g_debug("Removing variable \"%s\"", (*it)->title().c_str());
+        calc.expressionItemDeleted(*it);
+        data.definitions_generation += 1;
+    }
+
+    if (data.result_cache == nullptr) {
+        return;
+    }
+    if (result_cache_context.has_value()) {
+        data.result_cache->set_context(*result_cache_context);
+    } else {
+        data.result_cache->disable();
+    }
+}
+
+/** Shifts ans to ans2, ans2 to ans3 etc. and assigns the last result to ans */
+static void rotate_ans(ThreadData & data)
+{
+    auto & var_ans = data.var_ans;
+    alloc_counter::ExternalScope const libqalculate;
+
+    MathStructure m4(var_ans[3]->get());
+    m4.replace(var_ans[4], var_ans[4]->get());
+    var_ans[4]->set(m4);
+
+    MathStructure m3(var_ans[2]->get());
+    m3.replace(var_ans[3], var_ans[4]);
+    var_ans[3]->set(m3);
+
+    MathStructure m2(var_ans[1]->get());
+    m2.replace(var_ans[2], var_ans[3]);
+    var_ans[2]->set(m2);
+
+    MathStructure m1(var_ans[0]->get());
+    m1.replace(var_ans[1], var_ans[2]);
+    var_ans[1]->set(m1);
+
+    data.last_result->replace(var_ans[0], var_ans[1]);
+    var_ans[0]->set(*data.last_result);
+}
+
+/**
+ * Hands the result slot over to the main thread.
+ * @return Whether there is a result, as opposed to only messages
+ */
+static bool publish_result(ThreadData & data, CalculatorCommand & query)
+{
+    EvalResult & eval_result = data.results.back();
+    bool const has_result = !eval_result.result.empty();
+
+    // Hand the expression over with the result, swapping keeps both strings' buffers around
+    eval_result.expression.swap(query.expression);
+    data.current_rows = eval_result.rows;
+    data.results.publish();
+    data.eval_in_progress = false;
+
+    query.callback(query.userdata);
+    return has_result;
+}
+
+/** Publishes the coarse samples of an inline plot, to be replaced by the full ones later */
+static void publish_plot_preview(ThreadData & data, CalculatorCommand const & query,
+                                 std::shared_ptr<PlotSamples const> samples)
+{
+    EvalResult & preview = next_result(data);
+    preview.expression = query.expression;
+    preview.plot = std::move(samples);
+    preview.is_approximate = true;
+    data.results.publish();
+
+    query.callback(query.userdata);
+}
+
+/** Whether an evaluation newer than the one with the given serial has come in */
+static bool is_superseded(ThreadData const & data, unsigned serial)
+{
+    return serial != data.latest_query;
+}
+
+/**
+ * Prints the result in every alternate format, a format per step.
+ * The rows are published all at once when the last format is done, unless a newer evaluation has
+ * come in by then.
+ * @param serial Value of ThreadData::latest_query when the evaluation came in
+ */
+static Task print_alternate_formats(ThreadData & data, TaskScheduler & scheduler, MathStructure mstruct,
+                                    PrintOptions const & po, EvalCallback callback, void * userdata,
+                                    unsigned serial)
+{
+    std::vector<std::string> texts;
+    texts.reserve(data.result_formats.size());
+
+    for (auto const * format : data.result_formats) {
+        if (is_superseded(data, serial)) {
+            co_return;
         }
 
-        data.eval_in_progress = true;
+        PrintOptions format_po = po;
+        format->apply(format_po);
         {
-            std::lock_guard lock(data.mtx_queued_query);
-            query = data.queued_query;
+            alloc_counter::ExternalScope const libqalculate;
+            MathStructure formatted(mstruct);
+            formatted.format(format_po);
+            texts.push_back(formatted.print(format_po));
         }
+        co_await scheduler.yield();
+    }
+    if (is_superseded(data, serial)) {
+        co_return;
+    }
 
-        log_messages.clear();
-        g_debug("Evaluating %s...", query.expression.c_str());
+    auto & rows = data.alternate_results.back().rows;
+    rows.clear();
+    for (size_t i = 0; i < texts.size(); ++i) {
+        rows.emplace_back(data.result_formats[i], std::move(texts[i]));
+    }
+    data.alternate_results.publish();
+    callback(userdata);
+}
 
-        if (query.callback == nullptr) {
-            g_warning("Missing callback!");
-            log_messages.emplace_back(ERROR, "Missing callback");
-            goto exit;
+/**
+ * Evaluates plain arithmetic without libqalculate's parser, see native_eval.h.
+ * @param ms Receives the result
+ * @return Whether the expression was plain arithmetic, the result slot is filled in if so
+ */
+static bool evaluate_native(ThreadData & data, std::string const & expression, PrintOptions const & po,
+                            MathStructure & ms)
+{
+    // Number is libqalculate's, so are its allocations
+    alloc_counter::ExternalScope const libqalculate;
+    Number value;
+
+    if (!native_eval::evaluate(expression, value)) {
+        return false;
+    }
+    g_debug("Evaluated as plain arithmetic");
+
+    ms.set(value);
+    print_result(*data.calc, data.options, ms, data.options.eval_timeout_ms, po, next_result(data));
+    data.last_result->set(ms);
+    return true;
+}
+
+/** Loads the definition categories an unlocalized expression needs, if they haven't been loaded yet */
+static void load_definitions_for_expression(ThreadData & data, std::string const & expression)
+{
+    if (data.definitions_loaded == definitions::ALL) {
+        return;
+    }
+    unsigned const loaded = definitions::load_for_expression(
+        *data.calc, expression, data.definitions_loaded, &data.definitions_index);
+    if (loaded != data.definitions_loaded) {
+        data.definitions_loaded = loaded;
+        data.definitions_generation += 1;
+    }
+}
+
+/** Longest range evaluate_range() accepts */
+static constexpr size_t MAX_RANGE_ROWS = 1000000;
+
+/**
+ * Evaluates "EXPR for VAR = A..B" into result rows, see ResultRows::from_range().
+ * Only the expression is parsed here, the values are evaluated once their rows are shown.
+ */
+static void evaluate_range(ThreadData & data, parsing::ParsedRange const & range)
+{
+    auto & calc = *data.calc;
+    EvaluationOptions const & eo = default_evaluation_options;
+    EvalResult & eval_result = next_result(data);
+    // Unsigned, so the difference of far apart bounds doesn't overflow
+    size_t const count = static_cast<unsigned long>(range.last) - static_cast<unsigned long>(range.first) + 1;
+
+    g_debug("Evaluating range of %zu values", count);
+    if (count > MAX_RANGE_ROWS || count == 0) {
+        eval_result.messages.add(ERROR, "Ranges are limited to {} values", MAX_RANGE_ROWS);
+        return;
+    }
+
+    alloc_counter::ExternalScope const libqalculate;
+    std::string const expression = calc.unlocalizeExpression(std::string{range.expression}, eo.parse_options);
+    load_definitions_for_expression(data, expression);
+
+    MathStructure const parsed = calc.parse(expression, eo.parse_options);
+    MathStructure const variable = calc.parse(std::string{range.variable}, eo.parse_options);
+    eval_result.rows = ResultRows::from_range(parsed, variable, range.variable, range.first, count);
+}
+
+/** Whether apply_conversion() handles the conversion of the expression */
+static bool is_applicable_conversion(ParsedExpression const & parsed)
+{
+    return parsed.kind == QueryKind::CONVERSION && parsed.parsed != nullptr
+        && (parsed.is_unit_conversion || find_result_format(parsed.conversion) != nullptr);
+}
+
+/** Keeps the evaluated expression, before any conversion, see ThreadData::base_result */
+static void keep_base_result(ThreadData & data, std::string const & expression, MathStructure const & ms)
+{
+    data.base_result->set(ms);
+    data.base_expression.assign(expression);
+    data.base_generation = data.definitions_generation;
+}
+
+/**
+ * Kept result of the expression without its conversion, nullptr if it wasn't kept or is stale.
+ * Expressions using ans, now() and the like are evaluated again every time, rotating ans or the
+ * clock doesn't change definitions_generation.
+ */
+static MathStructure const * find_base_result(ThreadData const & data, ParsedExpression const & parsed)
+{
+    if (!is_applicable_conversion(parsed) || data.base_expression != parsed.base
+            || data.base_generation != data.definitions_generation || !ResultCache::is_cacheable(parsed.base)) {
+        return nullptr;
+    }
+    return data.base_result.get();
+}
+
+/**
+ * Converts an evaluated expression to units, or prints it in one of the formats of result_formats.h,
+ * whichever the conversion of the query asks for.
+ * @param ms Receives the converted result
+ * @return Whether the conversion finished within timeout_ms, the result slot is printed into if so
+ */
+static bool apply_conversion(ThreadData & data, ParsedExpression const & parsed, MathStructure const & base,
+                             int timeout_ms, PrintOptions const & po, EvalResult & eval_result, MathStructure & ms)
+{
+    auto & calc = *data.calc;
+
+    if (parsed.is_unit_conversion) {
+        calc.startControl(timeout_ms);
+        ms.set(calc.convert(base, parsed.conversion, default_evaluation_options));
+        bool const timed_out = calc.aborted();
+        calc.stopControl();
+        if (timed_out) {
+            return false;
+        }
+        print_result(calc, data.options, ms, timeout_ms, po, eval_result);
+        return true;
+    }
+
+    PrintOptions format_po = po;
+    find_result_format(parsed.conversion)->apply(format_po);
+    ms.set(base);
+    print_result(calc, data.options, ms, timeout_ms, format_po, eval_result);
+    return true;
+}
+
+/** Keeps a result in the result cache, done in the background as it writes to the cache file */
+static Task store_cached_result(ResultCache & cache, std::string expression, std::string result, uint64_t context)
+{
+    cache.store(expression, result, context);
+    co_return;
+}
+
+/**
+ * Hands an evaluated result over to the result cache, if there is one and the result is final.
+ * Evaluating an assignment changes the calculator in a way the cache can't tell, so it's done for
+ * the session then.
+ */
+static void cache_result(ThreadData & data, TaskScheduler & scheduler, ParsedExpression const & parsed,
+                         CalculatorCommand const & query, EvalResult const & eval_result)
+{
+    if (data.result_cache == nullptr) {
+        return;
+    }
+    if (parsed.kind == QueryKind::ASSIGNMENT) {
+        data.result_cache->disable();
+        return;
+    }
+    if ((parsed.kind != QueryKind::PLAIN && parsed.kind != QueryKind::CONVERSION) || eval_result.result.empty()
+            || eval_result.is_approximate || !eval_result.messages.empty() || eval_result.rows != nullptr) {
+        return;
+    }
+    scheduler.spawn(Priority::BACKGROUND,
+        store_cached_result(*data.result_cache, query.expression, eval_result.result,
+            data.result_cache->context()));
+}
+
+/**
+ * Evaluates an expression and publishes the result.
+ * The approximation and the alternate formats are followed up at DERIVED priority, an evaluation
+ * that comes in meanwhile goes first and makes the rest of this one pointless.
+ * @param serial Value of ThreadData::latest_query when the evaluation came in
+ */
+static Task evaluate_query(ThreadData & data, TaskScheduler & scheduler, CalculatorCommand query,
+                           unsigned serial, PrintOptions const & po)
+{
+    auto & calc = data.calc;
+    EvaluationOptions const & eo = default_evaluation_options;
+
+    MathStructure ms;
+    MathStructure approximation;
+    std::string approximate_result;
+    ParsedExpression const * parsed = nullptr;
+    bool is_plot_query;
+    bool print_parsed;
+    bool use_sandbox;
+    bool has_approximation = false;
+    bool is_converted = false;
+    MathStructure const * base_result = nullptr;
+    /* Divided by 2 due to the hack, read below */
+    int eval_timeout_ms = data.options.eval_timeout_ms / 2;
+
+    if (is_superseded(data, serial)) {
+        // A newer evaluation came in while this one was waiting for its turn
+        co_return;
+    }
+
+    data.eval_in_progress = true;
+    auto const allocations = alloc_counter::thread_counts();
+
+    // Alternate formats of the previous result don't belong to this one
+    if (!data.result_formats.empty()) {
+        clear_alternate_results(data);
+    }
+
+    g_debug("Evaluating %s...", query.expression.c_str());
+
+    if (query.callback == nullptr) {
+        g_warning("Missing callback!");
+        data.eval_in_progress = false;
+        co_return;
+    }
+
+    if (auto const range = parsing::parse_range_query(query.expression); range.has_value()) {
+        evaluate_range(data, *range);
+        publish_result(data, query);
+        alloc_counter::log_since("Evaluation", allocations);
+        co_return;
+    }
+
+    if (data.options.inline_plot) {
+        if (auto const plot = parsing::parse_plot_query(query.expression); plot.has_value()) {
+            // Coarse samples follow the typing, the full ones are only worth it once it pauses
+            auto const coarse = sample_plot(*calc, *plot, COARSE_PLOT_STEPS, eval_timeout_ms, eo);
+            if (coarse != nullptr) {
+                publish_plot_preview(data, query, coarse);
+
+                co_await scheduler.yield(Priority::DERIVED);
+                if (is_superseded(data, serial)) {
+                    co_return;
+                }
+                auto samples = sample_plot(*calc, *plot, PLOT_STEPS, eval_timeout_ms, eo);
+                next_result(data).plot = samples != nullptr ? std::move(samples) : coarse;
+                publish_result(data, query);
+                alloc_counter::log_since("Evaluation", allocations);
+                co_return;
+            }
+            // Whatever can't be sampled is left to gnuplot
         }
+    }
+
+    if (!data.options.no_native_eval && evaluate_native(data, query.expression, po, ms)) {
+        bool const has_result = publish_result(data, query);
+        alloc_counter::log_since("Evaluation", allocations);
 
-        unlocalized_expr = calc->unlocalizeExpression(query.expression);
-        is_plot_query = starts_with(unlocalized_expr.c_str(), "plot(");
-
-        /*
-         * A bit hackish, but:
-         *  - calculate() and print() don't support "to" expressions;
-         *  - calculateAndPrint() doesn't support plotting;
-         *  - calculateAndPrint() doesn't give out the resulting MathStructure (for ans vars).
-         * Looking through the libqalculate code it looks like I'd have to lift a huge chunk of
-         * code to make calculate() and print() support "to" expressions.
-         *
-         * So instead let's do a dirty hack and just run it through calculate() first to get the
-         * MathStructure, then (if not a plot) then calculate it again in calculateAndPrint().
-         * Should be fine (for my use case :)) since I only use the rofi calc for simple
-         * calculations.
-         */
-        if (!calc->calculate(&ms, unlocalized_expr, eval_timeout_ms, eo)) {
+        if (has_result && !data.result_formats.empty()) {
+            scheduler.spawn(Priority::DERIVED, print_alternate_formats(
+                data, scheduler, ms, po, query.callback, query.userdata, serial));
+        }
+        co_return;
+    }
+
+    parsed = &data.expression_cache.get(*calc, query.expression, eo, data.definitions_generation);
+    if (data.definitions_loaded != definitions::ALL) {
+        unsigned const loaded = definitions::load_for_expression(
+            *calc, parsed->unlocalized, data.definitions_loaded, &data.definitions_index);
+        if (loaded != data.definitions_loaded) {
+            data.definitions_loaded = loaded;
+            data.definitions_generation += 1;
+            parsed = &data.expression_cache.get(*calc, query.expression, eo, data.definitions_generation);
+        }
+    }
+    if (!data.exchange_rates_loaded
+            && exchange_rates::expression_needs_rates(*calc, parsed->unlocalized)) {
+        load_exchange_rates(data);
+        parsed = &data.expression_cache.get(*calc, query.expression, eo, data.definitions_generation);
+    }
+    is_plot_query = parsed->kind == QueryKind::PLOT;
+    print_parsed = parsed->parsed != nullptr
+        && (parsed->kind == QueryKind::PLAIN
+            || (parsed->kind == QueryKind::CONVERSION && parsed->is_unit_conversion));
+    // Assignments and plots change the calculator or open gnuplot, so they stay in-process
+    use_sandbox = data.sandbox != nullptr
+        && (parsed->kind == QueryKind::PLAIN || parsed->kind == QueryKind::CONVERSION);
+    // Only the "to ..." part changed since the expression was evaluated, e.g. "3 km to mi" to "3 km to ft"
+    if (!use_sandbox) {
+        base_result = find_base_result(data, *parsed);
+    }
+
+    if (print_parsed && !use_sandbox && base_result == nullptr && data.options.progressive_eval_ms > 0) {
+        gint64 const start_us = g_get_monotonic_time();
+        int const budget_ms = std::min<int>(data.options.progressive_eval_ms, eval_timeout_ms);
+
+        has_approximation = evaluate_approximation(
+            *calc, *parsed, eo, po, budget_ms, approximation, approximate_result);
+        if (has_approximation) {
+            // Publishes into the result slot, so it has to happen before grabbing it below
+            publish_approximation(data, query, approximate_result);
+            int const elapsed_ms = static_cast<int>((g_get_monotonic_time() - start_us) / 1000);
+            eval_timeout_ms = std::max(1, eval_timeout_ms - elapsed_ms);
+
+            // Refining only matters if this is still what's being typed
+            co_await scheduler.yield(Priority::DERIVED);
+            if (is_superseded(data, serial)) {
+                alloc_counter::log_since("Evaluation", allocations);
+                co_return;
+            }
+        }
+    }
+
+    EvalResult & eval_result = next_result(data);
+    std::string & result = eval_result.result;
+    LogMessages & log_messages = eval_result.messages;
+    eval_result.is_assignment = parsed->kind == QueryKind::ASSIGNMENT;
+
+    if (use_sandbox) {
+        if (evaluate_in_sandbox(data, query.expression, print_parsed, eval_timeout_ms, eval_result, ms)) {
+            abbreviate_printed_result(data.options, eval_result);
+            alloc_counter::ExternalScope const libqalculate;
+            data.last_result->set(ms);
+        }
+        goto exit;
+    }
+
+    /*
+     * A bit hackish, but:
+     *  - calculate() and print() don't support "to" expressions;
+     *  - calculateAndPrint() doesn't support plotting;
+     *  - calculateAndPrint() doesn't give out the resulting MathStructure (for ans vars).
+     * Looking through the libqalculate code it looks like I'd have to lift a huge chunk of
+     * code to make calculate() and print() support "to" expressions.
+     *
+     * So instead let's do a dirty hack and just run it through calculate() first to get the
+     * MathStructure, then (if not a plot) then calculate it again in calculateAndPrint().
+     * Should be fine (for my use case :)) since I only use the rofi calc for simple
+     * calculations.
+     *
+     * The exception are expressions without a conversion or with a conversion to units,
+     * calculate() handles those fine, so they're printed from the MathStructure as well.
+     * When the expression has been parsed before then calculate() starts from a copy of
+     * the parsed structure instead of parsing the text again.
+     *
+     * Conversions to units or to the formats of result_formats.h are applied to the evaluated
+     * expression, which is kept so a different conversion of it doesn't evaluate it again.
+     */
+    {
+        // Evaluating and printing allocate plenty, but those are libqalculate's allocations
+        alloc_counter::ExternalScope const libqalculate;
+
+        if (base_result != nullptr
+                && apply_conversion(data, *parsed, *base_result, eval_timeout_ms, po, eval_result, ms)) {
+            g_debug("Converted the result of \"%s\" again", parsed->base.c_str());
+            is_converted = true;
+        } else if (has_approximation && !approximation.isApproximate()) {
+            // Nothing had to be approximated, so the approximation is exact already
+            ms.set(approximation);
+        } else if (!has_approximation && is_applicable_conversion(*parsed)) {
+            ms.set(*parsed->parsed);
+            if (!calc->calculate(&ms, eval_timeout_ms, eo)) {
+                g_info("Timed out after %d ms!", eval_timeout_ms);
+                log_messages.add(ERROR, "Evaluation timed out after {} ms", eval_timeout_ms);
+                goto exit;
+            }
+            keep_base_result(data, parsed->base, ms);
+            if (!apply_conversion(data, *parsed, *data.base_result, eval_timeout_ms, po, eval_result, ms)) {
+                log_messages.add(ERROR, "Conversion timed out after {} ms", eval_timeout_ms);
+                goto exit;
+            }
+            is_converted = true;
+        } else if (parsed->parsed != nullptr) {
+            ms.set(*parsed->parsed);
+            if (!calc->calculate(&ms, eval_timeout_ms, eo, parsed->conversion)) {
+                g_info("Timed out after %d ms!", eval_timeout_ms);
+                if (!has_approximation) {
+                    log_messages.add(ERROR, "Evaluation timed out after {} ms", eval_timeout_ms);
+                    goto exit;
+                }
+                log_messages.add(WARNING,
+                    "Exact evaluation timed out after {} ms, showing an approximation",
+                    data.options.eval_timeout_ms);
+                ms.set(approximation);
+                result = std::move(approximate_result);
+                eval_result.is_approximate = true;
+            }
+        } else if (!calc->calculate(&ms, parsed->unlocalized, eval_timeout_ms, eo)) {
             g_info("Timed out after %d ms!", eval_timeout_ms);
-            log_messages.emplace_back(ERROR, "Evaluation timed out after {} ms", eval_timeout_ms);
+            log_messages.add(ERROR, "Evaluation timed out after {} ms", eval_timeout_ms);
             goto exit;
         }
 
+        if (parsed->kind == QueryKind::PLAIN && parsed->parsed != nullptr && !eval_result.is_approximate) {
+            keep_base_result(data, parsed->base, ms);
+        }
+
         // calculateAndPrint doesn't show plots??
-        if (is_plot_query) {
-            result = calc->print(ms, eval_timeout_ms, po);
+        if (eval_result.is_approximate || is_converted) {
+            // Printed in the first phase or by apply_conversion() already
+        } else if (is_plot_query || print_parsed) {
+            print_result(*calc, data.options, ms, eval_timeout_ms, po, eval_result);
         } else {
             result = calc->calculateAndPrint(query.expression, eval_timeout_ms, eo, po);
+            abbreviate_printed_result(data.options, eval_result);
+        }
+    }
+
+    while (calc->message()) {
+        auto const & msg = *calc->message();
+        g_info("libqalculate message (%d): %s", msg.type(), msg.c_message());
+        log_messages.add(msg);
+        calc->nextMessage();
+    }
+
+    if (parsed->kind == QueryKind::ASSIGNMENT) {
+        // Names may refer to something else now
+        data.definitions_generation += 1;
+    }
+    g_debug("Finished evaluation");
+
+    data.is_plot_open = calc->gnuplotOpen();
+    if (data.is_plot_open && !is_plot_query){
+        calc->closeGnuplot();
+    }
 
-            std::string warning;
-            while (calc->message()) {
-                auto const & msg = *calc->message();
-                g_info("libqalculate message (%d): %s", msg.type(), msg.c_message());
-                log_messages.emplace_back(msg);
-                calc->nextMessage();
+    if (data.options.dump_local_variables) {
+        for (auto * var : calc->variables) {
+            if (var->isLocal()) {
+                auto * kv = dynamic_cast<KnownVariable *>(var);
+                g_debug("Local variable dump: \"%s\" has value \"%s\"",
+                    kv->name(false).c_str(), kv->get().print().c_str());
             }
         }
-        g_debug("Finished evaluation");
+    }
+
+    {
+        alloc_counter::ExternalScope const libqalculate;
+        data.last_result->set(ms);
+    }
+
+exit:
+    // The result slot and the expression go to the main thread when publishing
+    cache_result(data, scheduler, *parsed, query, data.results.back());
+    bool const has_result = publish_result(data, query);
+    bool const has_alternate_formats = parsed->kind != QueryKind::PLOT
+        && parsed->kind != QueryKind::ASSIGNMENT;
+    alloc_counter::log_since("Evaluation", allocations);
 
-        data.is_plot_open = calc->gnuplotOpen();
-        if (data.is_plot_open && !is_plot_query){
-            calc->closeGnuplot();
+    if (has_result && has_alternate_formats && !data.result_formats.empty()) {
+        scheduler.spawn(Priority::DERIVED, print_alternate_formats(
+            data, scheduler, ms, po, query.callback, query.userdata, serial));
+    }
+}
+
+/**
+ * Prints the chunk of result rows a row is in, a row per step.
+ * Dropped once the rows don't belong to the latest result anymore.
+ */
+static Task generate_rows(ThreadData & data, TaskScheduler & scheduler, std::shared_ptr<ResultRows> rows,
+                          size_t row, EvalCallback callback, void * userdata, PrintOptions const & po)
+{
+    size_t const chunk = row / ResultRows::CHUNK_SIZE;
+    size_t const first = chunk * ResultRows::CHUNK_SIZE;
+    size_t const last = std::min(rows->size(), first + ResultRows::CHUNK_SIZE);
+    std::vector<std::string> texts;
+
+    texts.reserve(last - first);
+    for (size_t i = first; i < last; ++i) {
+        if (rows != data.current_rows) {
+            co_return;
         }
+        texts.push_back(rows->print_row(*data.calc, i, data.options.eval_timeout_ms, default_evaluation_options, po));
+        co_await scheduler.yield();
+    }
 
-        if (data.options.dump_local_variables) {
-            for (auto * var : calc->variables) {
-                if (var->isLocal()) {
-                    auto * kv = dynamic_cast<KnownVariable *>(var);
-                    g_debug("Local variable dump: \"%s\" has value \"%s\"",
-                        kv->name(false).c_str(), kv->get().print().c_str());
-                }
+    rows->publish(chunk, std::move(texts));
+    callback(userdata);
+}
+
+/**
+ * Evaluates history entries again, an entry per step. New results are handed over one at a time,
+ * as soon as they're printed, entries whose result stayed the same are left out.
+ */
+static Task recompute_history(ThreadData & data, TaskScheduler & scheduler, std::vector<HistoryEntry> entries,
+                              EvalCallback callback, void * userdata, PrintOptions const & po)
+{
+    auto & calc = *data.calc;
+    EvaluationOptions const & eo = default_evaluation_options;
+    int const timeout_ms = data.options.eval_timeout_ms;
+
+    for (auto & entry : entries) {
+        std::string result;
+        {
+            alloc_counter::ExternalScope const libqalculate;
+            std::string const expression = calc.unlocalizeExpression(entry.expression, eo.parse_options);
+            load_definitions_for_expression(data, expression);
+            if (!data.exchange_rates_loaded && exchange_rates::expression_needs_rates(calc, expression)) {
+                load_exchange_rates(data);
+            }
+
+            // Same dance as evaluate_query(), calculate() tells about the timeout, calculateAndPrint()
+            // handles "to" expressions
+            MathStructure ms;
+            if (calc.calculate(&ms, expression, timeout_ms, eo)) {
+                result = calc.calculateAndPrint(entry.expression, timeout_ms, eo, po);
             }
+            calc.clearMessages();
         }
 
-        data.last_result->set(ms);
+        if (!result.empty() && result != entry.result) {
+            g_debug("Recomputed \"%s\" = \"%s\", was \"%s\"",
+                entry.expression.c_str(), result.c_str(), entry.result.c_str());
+            entry.result = std::move(result);
+            {
+                std::lock_guard lock(data.mtx_recomputed_history);
+                data.recomputed_history.push_back(std::move(entry));
+            }
+            if (callback != nullptr) {
+                callback(userdata);
+            }
+        }
+        co_await scheduler.yield();
+    }
+}
 
-exit:
-        data.eval_in_progress = false;
-        query.callback(result, log_messages, query.userdata);
+/**
+ * Prints an abbreviated result in full for the history entry it was added as. The result is
+ * destroyed here as well, it was created on this thread.
+ */
+static Task print_full_result(ThreadData & data, std::unique_ptr<MathStructure> result, HistoryEntry entry,
+                              EvalCallback callback, void * userdata, PrintOptions const & po)
+{
+    {
+        alloc_counter::ExternalScope const libqalculate;
+        entry.result = data.calc->print(*result, data.options.eval_timeout_ms, po);
+        result.reset();
+    }
+    g_debug("Printed the result of \"%s\" in full, %zu bytes", entry.expression.c_str(), entry.result.length());
+
+    {
+        std::lock_guard lock(data.mtx_recomputed_history);
+        data.full_results.push_back(std::move(entry));
+    }
+    data.full_results_pending -= 1;
+    data.full_results_pending.notify_all();
+    if (callback != nullptr) {
+        callback(userdata);
+    }
+    co_return;
+}
+
+template <typename Item>
+static void add_completion_names(CompletionIndex & index, std::vector<Item *> const & items)
+{
+    for (auto const * item : items) {
+        if (!item->isActive() || item->isHidden()) {
+            continue;
+        }
+        for (size_t i = 1; i <= item->countNames(); ++i) {
+            index.add(item->getName(i).name);
+        }
+    }
+}
+
+/**
+ * Rebuilds the completion index from libqalculate's names, a kind of definition per step.
+ * Definitions changing meanwhile leave it stale, it's built again the next time around.
+ */
+static Task index_completion_names(ThreadData & data, TaskScheduler & scheduler)
+{
+    auto & calc = *data.calc;
+    CompletionIndex & index = data.completion_index.back();
+    unsigned const generation = data.definitions_generation;
+
+    index.clear();
+    add_completion_names(index, calc.units);
+    co_await scheduler.yield();
+    add_completion_names(index, calc.functions);
+    co_await scheduler.yield();
+    add_completion_names(index, calc.variables);
+    index.sort();
+    g_debug("Indexed %zu names for completion", index.size());
+
+    data.completion_index.publish();
+    data.indexed_generation = generation;
+}
+
+/**
+ * Takes the commands the main thread has pushed so far. Evaluations and loading exchange rates
+ * become tasks, changes to variables are made right away so they stay in order.
+ */
+static void take_commands(ThreadData & data, TaskScheduler & scheduler, PrintOptions const & po)
+{
+    size_t const pending = data.commands.size();
+    // Evaluations older than the newest one are out of date already
+    size_t last_evaluation = pending;
+    for (size_t i = 0; i < pending; ++i) {
+        if (data.commands[i].type == CommandType::EVALUATE) {
+            last_evaluation = i;
+        }
+    }
+
+    for (size_t i = 0; i < pending; ++i) {
+        CalculatorCommand & command = data.commands[0];
+
+        switch (command.type) {
+            case CommandType::EVALUATE:
+                if (i == last_evaluation) {
+                    data.latest_query += 1;
+                    scheduler.spawn(Priority::INTERACTIVE,
+                        evaluate_query(data, scheduler, std::move(command), data.latest_query, po));
+                }
+                break;
+            case CommandType::ADD_VARIABLES:
+                add_variables(data, command.variables);
+                break;
+            case CommandType::DELETE_VARIABLE:
+                delete_variable(data, command.name, command.result_cache_context);
+                break;
+            case CommandType::ROTATE_ANS:
+                rotate_ans(data);
+                break;
+            case CommandType::LOAD_EXCHANGE_RATES:
+                scheduler.spawn(Priority::BACKGROUND, load_exchange_rates_task(data, scheduler));
+                break;
+            case CommandType::GENERATE_ROWS:
+                scheduler.spawn(Priority::DERIVED, generate_rows(data, scheduler, std::move(command.rows),
+                    command.row, command.callback, command.userdata, po));
+                break;
+            case CommandType::RECOMPUTE_HISTORY:
+                scheduler.spawn(Priority::BACKGROUND, recompute_history(data, scheduler, std::move(command.entries),
+                    command.callback, command.userdata, po));
+                break;
+            case CommandType::RELEASE_ROWS:
+                command.rows.reset();
+                break;
+            case CommandType::PRINT_FULL_RESULT:
+                scheduler.spawn(Priority::DERIVED, print_full_result(data, std::move(command.unprinted_result),
+                    std::move(command.entries.front()), command.callback, command.userdata, po));
+                break;
+        }
+        data.commands.pop();
     }
 }
 
+/**
+ * Calculator thread entrypoint.
+ * A separate thread is used call libqalculate since some expressions can take a while to
+ * evaluate (and block the main thread). As the main thread is shared with rofi, then that also
+ * blocks the entire rofi window.
+ *
+ * The thread owns the Calculator once it's started, everything the main thread wants done with it
+ * arrives as a command. The main thread only sets it up before, see RofiQalc::start(). The work runs as tasks on a TaskScheduler, commands are taken whenever a task yields,
+ * so a new keystroke gets evaluated before the follow-ups of the previous one.
+ * @param data Thread data
+ */
+void RofiQalc::_calculator_thread_entry(ThreadData & data)
+{
+    PrintOptions const po = _result_print_options();
+    TaskScheduler scheduler;
+
+    if (data.options.background_sched_idle) {
+        scheduler.set_idle_background(TaskScheduler::can_use_idle_policy());
+    }
+    scheduler.set_poll([&data, &scheduler, &po] {
+        take_commands(data, scheduler, po);
+    });
+
+    for (;;) {
+        // Cleared before looking at the queue, so commands pushed from now on wake us up again
+        data.has_new_data = false;
+
+        if (data.should_quit.load()) {
+            break;
+        }
+
+        take_commands(data, scheduler, po);
+        if (scheduler.run_next()) {
+            continue;
+        }
+        // Once nothing else is left to do, the first time and after definitions have changed
+        if (data.indexed_generation != data.definitions_generation) {
+            scheduler.spawn(Priority::BACKGROUND, index_completion_names(data, scheduler));
+            continue;
+        }
+        data.has_new_data.wait(false);
+    }
+}
@@ -17,7 +17,13 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 #include "rofi_hacks.h"
+#include "alloc_counter.h"
+#include "plot_icon.h"
 #include "qalc.h"
+#include "result_display.h"
+
+#include <cmath>
+#include <format>
 
 #include <rofi/mode.h>
 #include <rofi/helper.h>
@@ -28,8 +34,19 @@
 
 using namespace rq;
 
+/** Main thread allocations when the last keystroke came in */
+static alloc_counter::Counts keystroke_allocations;
+
+/** Plot of the last result, see Options::inline_plot */
+static PlotIcon plot_icon;
+
+/** Input starting with this searches the history, see RofiQalc::search_history() */
+static constexpr char HISTORY_SEARCH_PREFIX = '?';
+
 typedef void (*MenuEntryCallback)(RofiQalc & state, MenuReturn action);
 
+static void eval_callback(void * userdata);
+
 struct rq_menu_entry
 {
     char const * title;
@@ -50,9 +67,9 @@ static RofiQalc & get_state(Mode const * sw)
     return *get_state_ptr(sw);
 }
 
-static void menu_entry_save_history(RofiQalc & state, MenuReturn action)
+static void save_to_history(RofiQalc & state, MenuReturn action, std::string_view alternate_result)
 {
-    if (state.previous_result.empty()) {
+    if (state.last_result().result.empty()) {
         g_info("Result is empty, not saving to history");
         return;
     }
@@ -60,9 +77,13 @@ static void menu_entry_save_history(RofiQalc & state, MenuReturn action)
         g_info("Result is plot, not saving to history");
         return;
     }
+    if (state.is_refining()) {
+        g_info("Result is an approximation being refined, not saving to history");
+        return;
+    }
 
     if (!state.options.no_history) {
-        state.append_result_to_history(action == MENU_OK);
+        state.append_result_to_history(action == MENU_OK, alternate_result);
     }
 
     state.update_ans();
@@ -77,14 +98,54 @@ static void menu_entry_save_history(RofiQalc & state, MenuReturn action)
     }
 }
 
+static void menu_entry_save_history(RofiQalc & state, MenuReturn action)
+{
+    save_to_history(state, action, {});
+}
+
 static constexpr rq_menu_entry menu_entries[] = {
     { "Add to history",     menu_entry_save_history },
     // { "Clear variables",    menu_entry_save_history },
 };
 
+/*
+ * Rows are laid out as:
+ *  - menu entries;
+ *  - alternate formats of the result, if enabled;
+ *  - values of the result, if it's a vector or a range, see ResultRows;
+ *  - history, newest first.
+ * While searching the history the rows are the matches instead.
+ */
+
+static unsigned first_result_row_line(RofiQalc const & state)
+{
+    return std::size(menu_entries) + state.alternate_results().size();
+}
+
+static unsigned first_history_line(RofiQalc const & state)
+{
+    return first_result_row_line(state) + state.result_row_count();
+}
+
+static int selected_line_to_alternate_index(RofiQalc const & state, unsigned selected_line)
+{
+    if (selected_line < std::size(menu_entries) || selected_line >= first_result_row_line(state)) {
+        return -1;
+    }
+    return selected_line - std::size(menu_entries);
+}
+
+static int selected_line_to_result_row_index(RofiQalc const & state, unsigned selected_line)
+{
+    if (selected_line < first_result_row_line(state) || selected_line >= first_history_line(state)) {
+        return -1;
+    }
+    return selected_line - first_result_row_line(state);
+}
+
 static int selected_line_to_history_index(RofiQalc const & state, unsigned selected_line)
 {
-    return state.history.size() - (selected_line - std::size(menu_entries)) - 1;
+    return state.history.size() - (selected_line - first_history_line(state)) - 1;
 }
 
 static int rq_mode_init(Mode * sw)
@@ -97,6 +158,7 @@ static int rq_mode_init(Mode * sw)
         if (!state->options.no_history) {
             state->load_history();
         }
+        state->start();
 
         mode_set_private_data(sw, state);
     }
@@ -107,7 +169,17 @@ static int rq_mode_init(Mode * sw)
 
 static unsigned int rq_mode_get_num_entries(Mode const * sw)
 {
-    return std::size(menu_entries) + get_state(sw).history.size();
+    auto & state = get_state(sw);
+
+    // Only picked up here, so the rows don't shift between reloads
+    state.fetch_alternate_results();
+    state.fetch_result_rows();
+    state.fetch_recomputed_history();
+
+    if (state.is_searching_history()) {
+        return state.history_matches().size();
+    }
+    return first_history_line(state) + state.history.size();
 }
 
 static ModeMode rq_mode_result(Mode * sw, int menu_entry,
@@ -124,9 +196,15 @@ static ModeMode rq_mode_result(Mode * sw, int menu_entry,
     if (menu_entry & MENU_QUICK_SWITCH) {
         return static_cast<ModeMode>(menu_entry & MENU_LOWER_MASK);
     }
+    if (state.is_searching_history() && (menu_entry & (MENU_OK | MENU_ENTRY_DELETE | MENU_CUSTOM_INPUT))) {
+        // Matches are only there to complete from
+        return RELOAD_DIALOG;
+    }
     if (menu_entry & MENU_OK) {
         if (selected_line < std::size(menu_entries)) {
             menu_entries[selected_line].callback(state, MENU_OK);
+        } else if (int index = selected_line_to_alternate_index(state, selected_line); index >= 0) {
+            save_to_history(state, MENU_OK, state.alternate_results()[index].text);
         } else {
             // struct rq_history_entry const * entry = &state->history[0];
             // memcpy(state->append_postfix, entry->result, entry->result_len);
@@ -135,7 +213,7 @@ static ModeMode rq_mode_result(Mode * sw, int menu_entry,
         return RELOAD_DIALOG;
     }
     if (menu_entry & MENU_ENTRY_DELETE) {
-        if (selected_line >= std::size(menu_entries)) {
+        if (selected_line >= first_history_line(state)) {
             int entry_index = selected_line_to_history_index(state, selected_line);
             if (entry_index >= 0) {
                 state.erase_history_line(entry_index);
@@ -164,11 +242,40 @@ static void rq_mode_destroy(Mode * sw)
             state.save_history();
         }
     }
+    state.log_memory_report();
+    plot_icon.clear();
 
     delete get_state_ptr(sw);
     mode_set_private_data(sw, nullptr);
 }
 
+/**
+ * Result as shown in a row, abbreviated like the main result if it's too long.
+ * @note The returned string is valid until the next call
+ */
+static char const * row_result(RofiQalc const & state, std::string const & result)
+{
+    // Only used from the main thread
+    static std::string abbreviated;
+    unsigned const max_length = state.options.max_result_digits;
+
+    if (max_length > 0 && result_display::abbreviate(result, max_length, abbreviated)) {
+        return abbreviated.c_str();
+    }
+    return result.c_str();
+}
+
+/** Row of a history entry, same as HistoryEntry::print() but straight into the string handed to rofi */
+static char * history_row(RofiQalc const & state, HistoryEntry const & entry)
+{
+    return g_strconcat(
+        entry.persistent ? "" : "(tmp) ",
+        entry.expression.c_str(),
+        entry.is_assignment ? "" : HistoryEntry::separator.data(),
+        entry.is_assignment ? "" : row_result(state, entry.result),
+        nullptr);
+}
+
 static int rq_mode_token_match(G_GNUC_UNUSED Mode const * sw,
                                G_GNUC_UNUSED rofi_int_matcher ** tokens,
                                G_GNUC_UNUSED unsigned index)
@@ -184,40 +291,76 @@ static char* rq_mode_get_display_value(Mode const * sw, unsigned selected_line,
         return nullptr;
     }
 
-    auto const & state = get_state(sw);
+    auto & state = get_state(sw);
 
+    if (state.is_searching_history()) {
+        auto const & matches = state.history_matches();
+        return selected_line < matches.size() ? history_row(state, matches[selected_line]) : nullptr;
+    }
     if (selected_line < std::size(menu_entries)) {
         return g_strdup(menu_entries[selected_line].title);
     }
+    if (int index = selected_line_to_alternate_index(state, selected_line); index >= 0) {
+        auto const & [format, text] = state.alternate_results()[index];
+        return g_strdup_printf("%.*s: %s",
+            static_cast<int>(format->name.length()), format->name.data(), row_result(state, text));
+    }
+    if (int index = selected_line_to_result_row_index(state, selected_line); index >= 0) {
+        // Printed in chunks as they're shown, the view is reloaded once the chunk is there
+        auto const * row = state.result_row(index, eval_callback, &state);
+        return g_strdup(row != nullptr ? row_result(state, *row) : "…");
+    }
 
     int entry_index = selected_line_to_history_index(state, selected_line);
     if (entry_index < 0) {
         return nullptr;
     }
-    auto const & entry = state.history[entry_index];
+    return history_row(state, state.history[entry_index]);
+}
 
-    auto entry_str = entry.print();
-    if (!entry.persistent) {
-        entry_str = "(tmp) " + entry_str;
-    }
+/** The plot of the result is the icon of the first row, none of the others have one */
+static cairo_surface_t * rq_mode_get_icon(Mode const * sw, unsigned selected_line, unsigned height)
+{
+    auto & state = get_state(sw);
 
-    auto * history_line = static_cast<gchar*>(g_malloc(entry_str.length() + 1));
-    if (history_line == nullptr) {
-        g_error("Failed to allocate history line");
+    if (state.is_searching_history() || selected_line != 0) {
+        return nullptr;
     }
-    memcpy(history_line, entry_str.c_str(), entry_str.length());
-    history_line[entry_str.length()] = 0;
-
-    return history_line;
+    auto const & plot = state.last_result().plot;
+    if (plot == nullptr) {
+        plot_icon.clear();
+        return nullptr;
+    }
+    return plot_icon.get(plot, height);
 }
 
 char * rq_mode_get_completion(Mode const * sw, unsigned selected_line) {
-    auto const & state = get_state(sw);
+    auto & state = get_state(sw);
 
+    if (state.is_searching_history()) {
+        auto const & matches = state.history_matches();
+        if (selected_line >= matches.size()) {
+            return nullptr;
+        }
+        // Completes to the expression, so it's evaluated again
+        auto const & match = matches[selected_line];
+        return g_strdup(match.expression.empty() ? match.result.c_str() : match.expression.c_str());
+    }
     if (selected_line < std::size(menu_entries)) {
+        // Completes the name being typed, if there is one
+        if (auto const completed = state.complete_name(state.get_last_expression()); completed.has_value()) {
+            return g_strndup(completed->data(), completed->length());
+        }
         // A bit pointless to return this, but I'm really not sure what else to do here :-)
         return g_strdup(menu_entries[selected_line].title);
     }
+    if (int index = selected_line_to_alternate_index(state, selected_line); index >= 0) {
+        return g_strdup(state.alternate_results()[index].text.c_str());
+    }
+    if (int index = selected_line_to_result_row_index(state, selected_line); index >= 0) {
+        auto const * row = state.result_row(index, eval_callback, &state);
+        return row != nullptr ? g_strdup(row->c_str()) : nullptr;
+    }
 
     int entry_index = selected_line_to_history_index(state, selected_line);
     if (entry_index < 0) {
@@ -240,50 +383,82 @@ char * rq_mode_get_completion(Mode const * sw, unsigned selected_line) {
     return history_line;
 }
 
+/** Sums up a plot drawn as the icon, the ranges of x and of the function's real values */
+static void append_plot_summary(std::string & message, PlotSamples const & plot)
+{
+    if (std::isnan(plot.y_min)) {
+        std::format_to(std::back_inserter(message), "Plot: <b>no real values</b> for x = {:.4g} … {:.4g}",
+            plot.x_min, plot.x_max);
+        return;
+    }
+    std::format_to(std::back_inserter(message), "Plot: <b>y = {:.4g} … {:.4g}</b> for x = {:.4g} … {:.4g}",
+        plot.y_min, plot.y_max, plot.x_min, plot.x_max);
+}
+
 static char *rq_mode_get_message(Mode const * sw)
 {
-    auto const & state = get_state(sw);
+    auto & state = get_state(sw);
+    auto const & last_result = state.last_result();
+    auto const & result = last_result.result;
+    auto const & messages = last_result.messages;
+    bool const is_approximate = last_result.is_approximate;
+    // Only used from the main thread, reused so building the message doesn't allocate
+    static std::string message;
+
+    alloc_counter::log_since("Keystroke", keystroke_allocations);
+
+    if (state.is_searching_history()) {
+        return g_strdup_printf("History search: %zu matches", state.history_matches().size());
+    }
 
+    message.clear();
+    if (auto const * cached = state.cached_result(); cached != nullptr) {
+        // From an earlier session, the calculator thread hasn't got to the expression yet
+        message.append("Result: <b>").append(*cached).append("</b>");
+        return g_strndup(message.data(), message.length());
+    }
     if (state.is_eval_in_progress()) {
-        return g_strdup("Evaluating...");
+        if (!is_approximate) {
+            return g_strdup("Evaluating...");
+        }
+        // The approximate phase of progressive evaluation finished, the exact one didn't
+        if (last_result.plot != nullptr) {
+            append_plot_summary(message, *last_result.plot);
+        } else {
+            message.append("Result: ≈ <b>").append(result).append("</b>");
+        }
+        message.append("\nRefining...");
+        return g_strndup(message.data(), message.length());
     }
     if (state.is_plot_open()) {
         return g_strdup("Plot mode active");
     }
 
-    std::stringstream ss;
-    if (!state.previous_result.empty()) {
-        ss << "Result: <b>" << state.previous_result << "</b>";
+    if (!result.empty()) {
+        message.append(is_approximate ? "Result: ≈ <b>" : "Result: <b>").append(result).append("</b>");
+    } else if (last_result.rows != nullptr) {
+        message.append("Result: <b>").append(std::to_string(last_result.rows->size())).append(" values</b>");
+    } else if (last_result.plot != nullptr) {
+        append_plot_summary(message, *last_result.plot);
     }
-    if (!state.previous_messages.empty()) {
-        for (auto const & msg : state.previous_messages) {
-            if (msg.type < state.options.message_severity) {
-                continue;
-            }
-            ss << "\n" << msg.message;
+    for (auto const & msg : messages) {
+        if (msg.type < state.options.message_severity) {
+            continue;
         }
+        message.append("\n").append(msg.message);
     }
 
-    auto message = ss.str();
     if (message.empty()) {
         return g_strdup("Enter expression");
     }
 
-    auto ret = static_cast<char*>(g_malloc(message.length() + 1));
-    memcpy(ret, message.c_str(), message.length());
-    ret[message.length()] = 0;
-    return ret;
+    return g_strndup(message.data(), message.length());
 }
 
-static void eval_callback(std::string const & result,
-                          std::vector<LogMessage> const & messages, void * userdata)
+static void eval_callback(G_GNUC_UNUSED void * userdata)
 {
-    auto * state = static_cast<RofiQalc*>(userdata);
-    g_info("Reloading view %s", state->previous_result.c_str());
-
-    state->previous_result = result;
-    state->previous_messages = messages;
-
+    // The result itself is picked up by the main thread, in rq_mode_get_message
+    g_info("Reloading view");
     rofi_view_reload();
 }
 
@@ -292,6 +467,14 @@ static char * rq_mode_preprocess_input(Mode * sw, char const * input)
     auto & state = get_state(sw);
 
     g_info("Preprocess input %s", input);
+    keystroke_allocations = alloc_counter::thread_counts();
+
+    if (state.options.history_archive && input[0] == HISTORY_SEARCH_PREFIX) {
+        state.search_history(input + 1, eval_callback, &state);
+        rofi_view_reload();
+        return g_strdup(input);
+    }
+    state.end_history_search();
 
     state.evaluate(input, eval_callback, &state);
 
@@ -313,7 +496,7 @@ G_MODULE_EXPORT Mode mode =
     ._result                    = rq_mode_result,
     ._token_match               = rq_mode_token_match,
     ._get_display_value         = rq_mode_get_display_value,
-    ._get_icon                  = nullptr,
+    ._get_icon                  = rq_mode_get_icon,
     ._get_completion            = rq_mode_get_completion,
     ._preprocess_input          = rq_mode_preprocess_input,
     ._get_message               = rq_mode_get_message,
@@ -0,0 +1,570 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "sandbox.h"
+#include "definitions.h"
+#include "definitions_index.h"
+#include "exchange_rates.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <glib.h>
+#include <libqalculate/qalculate.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+/*
+ * The zygote reads single byte commands from the control socket:
+ *   'S' forks a worker, the reply is the worker's pid with its socket attached (SCM_RIGHTS),
+ *       a pid of -1 without a socket if that failed;
+ *   'K' followed by a pid kills that worker.
+ *
+ * Workers exchange frames of a u32 length followed by the payload, integers are in host byte
+ * order since both ends are the same binary. Strings are a u32 length followed by the bytes.
+ *   request: string expression, u8 print_parsed, i32 timeout_ms, u32 variable count,
+ *            { string name, string value } per variable
+ *   reply:   string result, string parsable result, u8 timed_out, u32 message count,
+ *            { u8 type, string text } per message
+ */
+static constexpr char CMD_SPAWN = 'S';
+static constexpr char CMD_KILL = 'K';
+
+/** State of the zygote and the workers, copied into them by fork() */
+struct WorkerContext
+{
+    Calculator & calc;
+    PrintOptions po;
+    unsigned definitions_loaded;
+    DefinitionsIndex definitions_index;
+    unsigned memory_limit_mb;
+    bool exchange_rates_loaded = false;
+    /** Values of the variables received so far, by name */
+    std::unordered_map<std::string, std::string> variables;
+    LogMessages messages;
+};
+
+/** Options for printing results so that they can be parsed back without losing precision */
+static PrintOptions parsable_print_options()
+{
+    PrintOptions po = default_print_options;
+    po.number_fraction_format = FRACTION_FRACTIONAL;
+    return po;
+}
+
+template <typename T>
+static void put(std::string & out, T const value)
+{
+    out.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+static void put_string(std::string & out, std::string_view const & str)
+{
+    put<uint32_t>(out, str.length());
+    out.append(str);
+}
+
+template <typename T>
+static bool get(std::string_view & in, T & value)
+{
+    if (in.length() < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+static bool get_string(std::string_view & in, std::string_view & str)
+{
+    uint32_t length;
+    if (!get(in, length) || in.length() < length) {
+        return false;
+    }
+    str = in.substr(0, length);
+    in.remove_prefix(length);
+    return true;
+}
+
+/** Writes all of data, without raising SIGPIPE if the other end is gone */
+static bool write_all(int fd, char const * data, size_t length)
+{
+    while (length > 0) {
+        ssize_t const written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * Reads exactly length bytes.
+ * @param deadline_us Monotonic time to give up at, 0 waits indefinitely
+ */
+static bool read_all(int fd, char * data, size_t length, gint64 deadline_us)
+{
+    while (length > 0) {
+        if (deadline_us != 0) {
+            gint64 const remaining_ms = (deadline_us - g_get_monotonic_time()) / 1000;
+            if (remaining_ms <= 0) {
+                return false;
+            }
+            pollfd pfd { fd, POLLIN, 0 };
+            int const ready = poll(&pfd, 1, static_cast<int>(remaining_ms));
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0) {
+                return false;
+            }
+        }
+
+        ssize_t const got = read(fd, data, length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        length -= got;
+    }
+    return true;
+}
+
+/** Starts a frame in buffer, keeping its capacity */
+static void begin_frame(std::string & buffer)
+{
+    buffer.assign(sizeof(uint32_t), '\0');
+}
+
+static bool send_frame(int fd, std::string & buffer)
+{
+    uint32_t const length = buffer.length() - sizeof(uint32_t);
+    std::memcpy(buffer.data(), &length, sizeof(length));
+    return write_all(fd, buffer.data(), buffer.length());
+}
+
+static bool receive_frame(int fd, std::string & buffer, gint64 deadline_us)
+{
+    uint32_t length;
+    if (!read_all(fd, reinterpret_cast<char *>(&length), sizeof(length), deadline_us)) {
+        return false;
+    }
+    buffer.resize(length);
+    return read_all(fd, buffer.data(), length, deadline_us);
+}
+
+/** Sends a pid and optionally a file descriptor, fd < 0 sends the pid only */
+static bool send_fd(int socket, pid_t pid, int fd)
+{
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    iovec iov { &pid, sizeof(pid) };
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (fd >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+    }
+
+    return sendmsg(socket, &msg, MSG_NOSIGNAL) == sizeof(pid);
+}
+
+/** Receives what send_fd() sent, returns the file descriptor or -1 if there was none */
+static int receive_fd(int socket, pid_t & pid)
+{
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    iovec iov { &pid, sizeof(pid) };
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket, &msg, MSG_CMSG_CLOEXEC) != sizeof(pid)) {
+        return -1;
+    }
+    cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+
+    int fd;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+    return fd;
+}
+
+/**
+ * Moves the CPU time limit ahead of the time used so far.
+ * RLIMIT_CPU covers the whole lifetime of the process, so it's renewed for every request.
+ */
+static void limit_cpu_time(int timeout_ms)
+{
+    rusage usage;
+    rlimit limit;
+    if (getrusage(RUSAGE_SELF, &usage) != 0 || getrlimit(RLIMIT_CPU, &limit) != 0) {
+        return;
+    }
+
+    // Both evaluation steps get timeout_ms, and a second to spare
+    rlim_t const budget_s = 2 * timeout_ms / 1000 + 1;
+    limit.rlim_cur = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + budget_s + 1;
+    if (limit.rlim_max != RLIM_INFINITY) {
+        limit.rlim_cur = std::min(limit.rlim_cur, limit.rlim_max);
+    }
+    setrlimit(RLIMIT_CPU, &limit);
+}
+
+static bool apply_variables(WorkerContext & ctx, std::string_view & in)
+{
+    uint32_t count;
+    if (!get(in, count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string_view name;
+        std::string_view value;
+        if (!get_string(in, name) || !get_string(in, value)) {
+            return false;
+        }
+
+        auto [it, inserted] = ctx.variables.try_emplace(std::string{name});
+        if (!inserted && it->second == value) {
+            continue;
+        }
+        it->second = value;
+
+        auto * variable = dynamic_cast<KnownVariable *>(ctx.calc.getActiveVariable(it->first));
+        if (variable != nullptr && variable->isLocal()) {
+            variable->set(it->second);
+        } else {
+            ctx.calc.addVariable(new KnownVariable(ctx.calc.temporaryCategory(), it->first, it->second));
+        }
+    }
+
+    return true;
+}
+
+/** Evaluates the request in buffer, replacing it with the reply */
+static bool worker_evaluate(WorkerContext & ctx, std::string & buffer)
+{
+    auto & calc = ctx.calc;
+    EvaluationOptions const & eo = default_evaluation_options;
+    std::string_view in{buffer};
+    std::string_view expression_view;
+    uint8_t print_parsed;
+    int32_t timeout_ms;
+
+    if (!get_string(in, expression_view) || !get(in, print_parsed) || !get(in, timeout_ms)
+            || !apply_variables(ctx, in)) {
+        return false;
+    }
+
+    std::string const expression{expression_view};
+    std::string const unlocalized = calc.unlocalizeExpression(expression, eo.parse_options);
+
+    // Same lazy loading as in the calculator thread
+    if (ctx.definitions_loaded != definitions::ALL) {
+        ctx.definitions_loaded = definitions::load_for_expression(
+            calc, unlocalized, ctx.definitions_loaded, &ctx.definitions_index);
+    }
+    if (!ctx.exchange_rates_loaded && exchange_rates::expression_needs_rates(calc, unlocalized)) {
+        ctx.exchange_rates_loaded = true;
+        ctx.definitions_loaded = definitions::load(
+            calc, definitions::CURRENCIES, ctx.definitions_loaded, &ctx.definitions_index);
+        exchange_rates::load(calc);
+    }
+
+    limit_cpu_time(timeout_ms);
+
+    MathStructure ms;
+    std::string result;
+    std::string parsable_result;
+    bool const finished = calc.calculate(&ms, unlocalized, timeout_ms, eo);
+    if (finished) {
+        result = print_parsed
+            ? calc.print(ms, timeout_ms, ctx.po)
+            : calc.calculateAndPrint(expression, timeout_ms, eo, ctx.po);
+        parsable_result = ms.print(parsable_print_options());
+    }
+
+    ctx.messages.clear();
+    while (calc.message()) {
+        ctx.messages.add(*calc.message());
+        calc.nextMessage();
+    }
+
+    begin_frame(buffer);
+    put_string(buffer, result);
+    put_string(buffer, parsable_result);
+    put<uint8_t>(buffer, !finished);
+    put<uint32_t>(buffer, ctx.messages.size());
+    for (auto const & message : ctx.messages) {
+        put<uint8_t>(buffer, message.type);
+        put_string(buffer, message.message);
+    }
+
+    return true;
+}
+
+[[noreturn]]
+static void worker_main(int fd, WorkerContext & ctx)
+{
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    if (ctx.memory_limit_mb > 0) {
+        rlim_t const limit_bytes = static_cast<rlim_t>(ctx.memory_limit_mb) << 20;
+        rlimit const limit { limit_bytes, limit_bytes };
+        setrlimit(RLIMIT_AS, &limit);
+    }
+
+    std::string buffer;
+    for (;;) {
+        if (!receive_frame(fd, buffer, 0) || !worker_evaluate(ctx, buffer) || !send_frame(fd, buffer)) {
+            _exit(0);
+        }
+    }
+}
+
+[[noreturn]]
+static void zygote_main(int control_fd, WorkerContext & ctx)
+{
+    // Dies along with rofi, and doesn't hold on to rofi's files (X connection etc.)
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (control_fd > 3) {
+        close_range(3, control_fd - 1, 0);
+    }
+    close_range(control_fd + 1, ~0U, 0);
+
+    std::vector<pid_t> workers;
+    for (;;) {
+        char command;
+        if (!read_all(control_fd, &command, sizeof(command), 0)) {
+            break;
+        }
+
+        // Reaps workers which died on their own
+        std::erase_if(workers, [](pid_t pid) { return waitpid(pid, nullptr, WNOHANG) > 0; });
+
+        if (command == CMD_SPAWN) {
+            int fds[2];
+            pid_t pid = -1;
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+                send_fd(control_fd, pid, -1);
+                continue;
+            }
+
+            pid = fork();
+            if (pid == 0) {
+                close(control_fd);
+                close(fds[0]);
+                worker_main(fds[1], ctx);
+            }
+            close(fds[1]);
+
+            if (pid > 0) {
+                workers.push_back(pid);
+            }
+            send_fd(control_fd, pid, pid > 0 ? fds[0] : -1);
+            close(fds[0]);
+        } else if (command == CMD_KILL) {
+            pid_t pid;
+            if (!read_all(control_fd, reinterpret_cast<char *>(&pid), sizeof(pid), 0)) {
+                break;
+            }
+            if (std::erase(workers, pid) > 0) {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+            }
+        }
+    }
+
+    for (pid_t const pid : workers) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    _exit(0);
+}
+
+Sandbox::Sandbox(Calculator & calc, PrintOptions const & po, unsigned definitions_loaded,
+                 DefinitionsIndex const & definitions_index, unsigned memory_limit_mb)
+{
+    WorkerContext ctx { calc, po, definitions_loaded, definitions_index, memory_limit_mb };
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        g_warning("Failed to create sandbox socket: %s", g_strerror(errno));
+        return;
+    }
+
+    pid_t const pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        zygote_main(fds[1], ctx);
+    }
+    close(fds[1]);
+
+    if (pid < 0) {
+        g_warning("Failed to start sandbox: %s", g_strerror(errno));
+        close(fds[0]);
+        return;
+    }
+    this->_zygote_pid = pid;
+    this->_control_fd = fds[0];
+
+    _spawn_worker();
+}
+
+Sandbox::~Sandbox()
+{
+    if (this->_worker_fd >= 0) {
+        close(this->_worker_fd);
+    }
+    if (this->_control_fd >= 0) {
+        // The zygote kills its workers and quits once the socket is closed
+        close(this->_control_fd);
+        waitpid(this->_zygote_pid, nullptr, 0);
+    }
+}
+
+bool Sandbox::_spawn_worker()
+{
+    if (this->_control_fd < 0 || !write_all(this->_control_fd, &CMD_SPAWN, sizeof(CMD_SPAWN))) {
+        return false;
+    }
+
+    pid_t pid = -1;
+    int const fd = receive_fd(this->_control_fd, pid);
+    if (fd < 0) {
+        g_warning("Failed to start sandbox worker");
+        return false;
+    }
+
+    g_debug("Started sandbox worker %d", pid);
+    this->_worker_fd = fd;
+    this->_worker_pid = pid;
+    return true;
+}
+
+void Sandbox::_kill_worker()
+{
+    g_debug("Killing sandbox worker %d", this->_worker_pid);
+
+    close(this->_worker_fd);
+    this->_worker_fd = -1;
+
+    char command[sizeof(CMD_KILL) + sizeof(pid_t)];
+    command[0] = CMD_KILL;
+    std::memcpy(command + sizeof(CMD_KILL), &this->_worker_pid, sizeof(pid_t));
+    write_all(this->_control_fd, command, sizeof(command));
+}
+
+SandboxStatus Sandbox::evaluate(Calculator & calc, std::string const & expression, bool print_parsed,
+                                int timeout_ms, int kill_after_ms, SandboxReply & reply)
+{
+    if (this->_worker_fd < 0 && !_spawn_worker()) {
+        return SandboxStatus::FAILED;
+    }
+
+    auto & buffer = this->_buffer;
+    begin_frame(buffer);
+    put_string(buffer, expression);
+    put<uint8_t>(buffer, print_parsed);
+    put<int32_t>(buffer, timeout_ms);
+
+    // Variable count is filled in after the variables
+    size_t const count_pos = buffer.length();
+    uint32_t count = 0;
+    put(buffer, count);
+    PrintOptions const parsable_po = parsable_print_options();
+    for (auto * variable : calc.variables) {
+        auto * known = dynamic_cast<KnownVariable *>(variable);
+        if (known == nullptr || !known->isLocal() || !known->isActive()) {
+            continue;
+        }
+        put_string(buffer, known->name());
+        put_string(buffer, known->isExpression() ? known->expression() : known->get().print(parsable_po));
+        count += 1;
+    }
+    std::memcpy(buffer.data() + count_pos, &count, sizeof(count));
+
+    gint64 const deadline_us = g_get_monotonic_time() + gint64{kill_after_ms} * 1000;
+    bool const replied = send_frame(this->_worker_fd, buffer)
+        && receive_frame(this->_worker_fd, buffer, deadline_us);
+    bool const timed_out = g_get_monotonic_time() >= deadline_us;
+
+    std::string_view in{buffer};
+    std::string_view result;
+    std::string_view parsable_result;
+    uint8_t libqalculate_timed_out;
+    uint32_t message_count;
+    bool ok = replied
+        && get_string(in, result) && get_string(in, parsable_result)
+        && get(in, libqalculate_timed_out) && get(in, message_count);
+
+    reply.messages.clear();
+    for (uint32_t i = 0; ok && i < message_count; ++i) {
+        uint8_t type;
+        std::string_view text;
+        ok = get(in, type) && get_string(in, text);
+        if (ok) {
+            reply.messages.add(static_cast<MessageType>(type), "{}", text);
+        }
+    }
+
+    if (!ok) {
+        g_warning("Sandbox worker %s", timed_out ? "timed out" : "died");
+        _kill_worker();
+        // The replacement is forked right away, so it's ready for the next expression
+        _spawn_worker();
+        return timed_out ? SandboxStatus::KILLED : SandboxStatus::CRASHED;
+    }
+
+    reply.result.assign(result);
+    reply.parsable_result.assign(parsable_result);
+    reply.timed_out = libqalculate_timed_out != 0;
+    return SandboxStatus::OK;
+}
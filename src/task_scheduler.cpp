@@ -0,0 +1,156 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "task_scheduler.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <glib.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+static bool set_scheduling_policy(int policy, pthread_t thread = pthread_self())
+{
+    sched_param const param{};
+    return pthread_setschedparam(thread, policy, &param) == 0;
+}
+
+bool TaskScheduler::YieldAwaiter::await_ready()
+{
+    if (this->_scheduler._poll) {
+        this->_scheduler._poll();
+    }
+    this->_scheduler._running.promise().priority = this->_priority;
+    return !this->_scheduler._has_more_urgent(this->_priority);
+}
+
+void TaskScheduler::YieldAwaiter::await_suspend(Task::Handle handle)
+{
+    // Ahead of tasks of the same priority, it was running already
+    this->_scheduler._ready[static_cast<size_t>(this->_priority)].push_front(handle);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    for (auto & ready : this->_ready) {
+        for (auto handle : ready) {
+            handle.destroy();
+        }
+    }
+}
+
+void TaskScheduler::set_poll(std::function<void()> poll)
+{
+    this->_poll = std::move(poll);
+}
+
+void TaskScheduler::set_idle_background(bool idle_background)
+{
+    this->_idle_background = idle_background;
+}
+
+void TaskScheduler::spawn(Priority priority, Task task)
+{
+    auto handle = task.release();
+    handle.promise().priority = priority;
+    this->_ready[static_cast<size_t>(priority)].push_back(handle);
+}
+
+bool TaskScheduler::run_next()
+{
+    for (auto & ready : this->_ready) {
+        if (ready.empty()) {
+            continue;
+        }
+        this->_running = ready.front();
+        ready.pop_front();
+
+        bool const idle = this->_idle_background
+            && this->_running.promise().priority == Priority::BACKGROUND;
+        if (idle) {
+            set_scheduling_policy(SCHED_IDLE);
+            // Work that came in before the switch didn't raise the thread, it's taken now instead
+            if (this->_poll) {
+                this->_poll();
+            }
+            if (_has_more_urgent(Priority::BACKGROUND)) {
+                set_scheduling_policy(SCHED_OTHER);
+                ready.push_front(this->_running);
+                this->_running = nullptr;
+                return true;
+            }
+        }
+
+        this->_running.resume();
+
+        if (idle) {
+            set_scheduling_policy(SCHED_OTHER);
+        }
+        if (this->_running.done()) {
+            this->_running.destroy();
+        }
+        this->_running = nullptr;
+        return true;
+    }
+    return false;
+}
+
+TaskScheduler::YieldAwaiter TaskScheduler::yield()
+{
+    return YieldAwaiter{*this, this->_running.promise().priority};
+}
+
+TaskScheduler::YieldAwaiter TaskScheduler::yield(Priority priority)
+{
+    return YieldAwaiter{*this, priority};
+}
+
+bool TaskScheduler::_has_more_urgent(Priority priority) const
+{
+    for (size_t i = 0; i < static_cast<size_t>(priority); ++i) {
+        if (!this->_ready[i].empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::can_use_idle_policy()
+{
+    bool round_trip = false;
+
+    // The calculator thread mustn't get stuck at SCHED_IDLE if switching back fails
+    std::thread probe{[&round_trip] {
+        round_trip = set_scheduling_policy(SCHED_IDLE) && set_scheduling_policy(SCHED_OTHER);
+    }};
+    probe.join();
+
+    if (!round_trip) {
+        g_warning("Can't switch between SCHED_IDLE and SCHED_OTHER, background tasks run at normal priority");
+    }
+    return round_trip;
+}
+
+void TaskScheduler::raise_from_idle(std::thread & thread)
+{
+    set_scheduling_policy(SCHED_OTHER, thread.native_handle());
+}
@@ -0,0 +1,142 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "variables_file.h"
+#include "parsing.h"
+
+#include <algorithm>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#undef G_LOG_DOMAIN
+#define G_LOG_DOMAIN "rq"
+
+using namespace rq;
+
+/** Overridden lines tolerated before load() rewrites the file, on top of one per variable */
+static constexpr size_t MAX_STALE_LINES = 64;
+
+VariablesFile::VariablesFile(std::string path)
+    : _path(std::move(path))
+{
+}
+
+VariablesFile::~VariablesFile()
+{
+    if (this->_file != nullptr) {
+        std::fclose(this->_file);
+    }
+}
+
+bool VariablesFile::load()
+{
+    GError * error = nullptr;
+    gchar * data = nullptr;
+    gsize size = 0;
+
+    this->_variables.clear();
+
+    if (!g_file_get_contents(this->_path.c_str(), &data, &size, &error)) {
+        g_debug("No variables file at %s: %s", this->_path.c_str(), error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    size_t line_count = 0;
+    std::string_view remaining{data, size};
+    while (!remaining.empty()) {
+        auto const newline = remaining.find('\n');
+        auto const line = remaining.substr(0, newline);
+        remaining.remove_prefix(newline == std::string_view::npos ? remaining.length() : newline + 1);
+
+        if (auto const parts = parsing::parse_variable_parts(line); parts.has_value() && !parts->name.empty()) {
+            _apply(parts->name, parts->value);
+            line_count += 1;
+        }
+    }
+    g_free(data);
+
+    g_debug("Loaded %zu variables from %zu lines of %s",
+        this->_variables.size(), line_count, this->_path.c_str());
+
+    if (line_count > this->_variables.size() + MAX_STALE_LINES) {
+        _rewrite();
+    }
+    return true;
+}
+
+void VariablesFile::set(std::string_view name, std::string_view value)
+{
+    _apply(name, value);
+    _append_line(name, value);
+}
+
+void VariablesFile::remove(std::string_view name)
+{
+    _apply(name, {});
+    _append_line(name, {});
+}
+
+void VariablesFile::_apply(std::string_view name, std::string_view value)
+{
+    auto const it = std::ranges::find(this->_variables, name, &VariableDefinition::name);
+    if (it != this->_variables.end()) {
+        this->_variables.erase(it);
+    }
+    if (!value.empty()) {
+        this->_variables.emplace_back(std::string{name}, std::string{value});
+    }
+}
+
+void VariablesFile::_append_line(std::string_view name, std::string_view value)
+{
+    if (this->_file == nullptr) {
+        this->_file = g_fopen(this->_path.c_str(), "a");
+        if (this->_file == nullptr) {
+            g_warning("Failed to open variables file %s", this->_path.c_str());
+            return;
+        }
+    }
+
+    std::fprintf(this->_file, "%.*s := %.*s\n",
+        static_cast<int>(name.length()), name.data(), static_cast<int>(value.length()), value.data());
+    // Flushed right away, the mode may not get to shut down cleanly
+    std::fflush(this->_file);
+}
+
+void VariablesFile::_rewrite()
+{
+    GError * error = nullptr;
+    std::string data;
+
+    for (auto const & [name, value] : this->_variables) {
+        data.append(name).append(" := ").append(value).append("\n");
+    }
+
+    // Appends after this have to go to the new file
+    if (this->_file != nullptr) {
+        std::fclose(this->_file);
+        this->_file = nullptr;
+    }
+
+    g_debug("Rewriting %s with %zu variables", this->_path.c_str(), this->_variables.size());
+    if (!g_file_set_contents(this->_path.c_str(), data.data(), static_cast<gssize>(data.length()), &error)) {
+        g_warning("Failed to write variables file: %s", error->message);
+        g_error_free(error);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "history_archive.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glib.h>
+
+using namespace rq;
+
+static std::filesystem::path make_scratch_dir()
+{
+    gchar * tmp = g_dir_make_tmp("rq-archive-test-XXXXXX", nullptr);
+    g_assert_nonnull(tmp);
+    std::filesystem::path const scratch_dir{tmp};
+    g_free(tmp);
+    return scratch_dir;
+}
+
+static void append_entry(std::filesystem::path const & dir, std::string expression, std::string result)
+{
+    HistoryArchive archive{dir.string()};
+    g_assert_true(archive.append({HistoryEntry{std::move(expression), std::move(result), true, false}}));
+}
+
+/** Leaves bytes at the end of the index, as a crash in the middle of writing to it does */
+static void tear_index(std::filesystem::path const & index_path, std::string_view bytes)
+{
+    std::ofstream index{index_path, std::ios::binary | std::ios::app};
+    index.write(bytes.data(), static_cast<std::streamsize>(bytes.length()));
+}
+
+/** Expressions of all entries in the archive, newest first */
+static std::vector<std::string> archived_expressions(std::filesystem::path const & dir)
+{
+    HistoryArchive archive{dir.string()};
+    std::vector<HistoryEntry> matches;
+    // Too short to have trigrams, so every block is read
+    archive.search("+", 100, matches);
+
+    std::vector<std::string> expressions;
+    for (auto const & match : matches) {
+        expressions.push_back(match.expression);
+    }
+    return expressions;
+}
+
+static void test_append_after_torn_record()
+{
+    auto const dir = make_scratch_dir();
+
+    append_entry(dir, "1+1", "2");
+    tear_index(dir / "000000.idx", "torn");
+    append_entry(dir, "2+2", "4");
+    append_entry(dir, "3+3", "6");
+
+    auto const expressions = archived_expressions(dir);
+    g_assert_cmpuint(expressions.size(), ==, 3);
+    g_assert_cmpstr(expressions[0].c_str(), ==, "3+3");
+    g_assert_cmpstr(expressions[1].c_str(), ==, "2+2");
+    g_assert_cmpstr(expressions[2].c_str(), ==, "1+1");
+
+    std::filesystem::remove_all(dir);
+}
+
+static void test_append_after_torn_magic()
+{
+    auto const dir = make_scratch_dir();
+
+    tear_index(dir / "000000.idx", "RQH");
+    append_entry(dir, "1+1", "2");
+
+    auto const expressions = archived_expressions(dir);
+    g_assert_cmpuint(expressions.size(), ==, 1);
+    g_assert_cmpstr(expressions[0].c_str(), ==, "1+1");
+
+    std::filesystem::remove_all(dir);
+}
+
+int main(int argc, char ** argv)
+{
+    g_test_init(&argc, &argv, nullptr);
+    g_test_add_func("/history-archive/append-after-torn-record", test_append_after_torn_record);
+    g_test_add_func("/history-archive/append-after-torn-magic", test_append_after_torn_magic);
+    return g_test_run();
+}
@@ -0,0 +1,70 @@
+/*
+* rofi-qalculate
+ * Copyright (C) 2024-2025 svenvvv
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include "parsing.h"
+
+#include <glib.h>
+
+using namespace rq;
+
+static void test_range_query()
+{
+    auto const parsed = parsing::parse_range_query("x^2 for x = 1..10");
+    g_assert_true(parsed.has_value());
+    g_assert_true(parsed->expression == "x^2");
+    g_assert_true(parsed->variable == "x");
+    g_assert_cmpint(parsed->first, ==, 1);
+    g_assert_cmpint(parsed->last, ==, 10);
+
+    auto const negative = parsing::parse_range_query("n\tfor\tn=-3 .. 3");
+    g_assert_true(negative.has_value());
+    g_assert_true(negative->variable == "n");
+    g_assert_cmpint(negative->first, ==, -3);
+    g_assert_cmpint(negative->last, ==, 3);
+}
+
+static void test_range_query_keyword_in_name()
+{
+    // "for" inside a name isn't the keyword, on either side
+    g_assert_false(parsing::parse_range_query("x formula = 1..3").has_value());
+    g_assert_false(parsing::parse_range_query("xfor x = 1..3").has_value());
+
+    // The last standalone "for" is the keyword, even with a name containing it after it
+    auto const parsed = parsing::parse_range_query("before for fortune = 1..3");
+    g_assert_true(parsed.has_value());
+    g_assert_true(parsed->expression == "before");
+    g_assert_true(parsed->variable == "fortune");
+}
+
+static void test_range_query_rejected()
+{
+    g_assert_false(parsing::parse_range_query("for x = 1..3").has_value());
+    g_assert_false(parsing::parse_range_query("x for 2x = 1..3").has_value());
+    g_assert_false(parsing::parse_range_query("x for x = 3..1").has_value());
+    g_assert_false(parsing::parse_range_query("x for x = 1.5..3").has_value());
+    g_assert_false(parsing::parse_range_query("x for x..3 = 1").has_value());
+}
+
+int main(int argc, char ** argv)
+{
+    g_test_init(&argc, &argv, nullptr);
+    g_test_add_func("/parsing/range-query", test_range_query);
+    g_test_add_func("/parsing/range-query-keyword-in-name", test_range_query_keyword_in_name);
+    g_test_add_func("/parsing/range-query-rejected", test_range_query_rejected);
+    return g_test_run();
+}